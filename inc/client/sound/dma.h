@@ -41,6 +41,7 @@ typedef struct {
     void (*begin_painting)(void);
     void (*submit)(void);
     void (*activate)(bool active);
+    bool threaded;  // begin_painting and submit may run on mixer thread
 } snddma_driver_t;
 
 extern dma_t    dma;
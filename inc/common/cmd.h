@@ -41,6 +41,7 @@ typedef struct cmdbuf_s {
     char        *text; // may not be NULL terminated
     size_t      cursize;
     size_t      maxsize;
+    size_t      readcount;  // offset of unexecuted text
     int         waitCount;
     int         aliasCount; // for detecting runaway loops
     void        (*exec)(struct cmdbuf_s *, const char *);
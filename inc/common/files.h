@@ -58,6 +58,7 @@ int FS_RenameFile(const char *from, const char *to);
 #endif
 
 int FS_CreatePath(char *path);
+void FS_InvalidateCache(void);
 
 int64_t FS_OpenFile(const char *filename, qhandle_t *f, unsigned mode);
 int     FS_CloseFile(qhandle_t f);
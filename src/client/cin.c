@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "client.h"
+#include "system/pthread.h"
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -26,6 +27,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <libswscale/swscale.h>
 
 #define MAX_PACKETS     2048    // max packets in queue
+#define MAX_FRAMES      32      // max decoded frames in queue
+
+#define VIDEO_FRAMES    4       // decoded video frames buffered ahead
+#define AUDIO_FRAMES    32      // converted audio frames buffered ahead
 
 typedef struct {
     AVFifo      *pkt_list;
@@ -33,13 +38,26 @@ typedef struct {
     int64_t     duration;
 } PacketQueue;
 
+typedef struct {
+    AVFrame     *frames[MAX_FRAMES];
+    unsigned    timestamps[MAX_FRAMES];
+    int         head;
+    int         count;
+    int         size;
+} FrameQueue;
+
+// dec_ctx, queue and decoded are owned by decoder thread, timestamp, frame
+// and done by main thread. ready and eof are protected by cin.lock.
 typedef struct {
     AVCodecContext  *dec_ctx;
     PacketQueue     queue;
+    FrameQueue      ready;
+    unsigned        decoded;
     unsigned        timestamp;
     int             stream_idx;
     AVFrame         *frame;
     bool            eof;
+    bool            done;
 } DecoderState;
 
 typedef struct {
@@ -70,6 +88,15 @@ typedef struct {
     unsigned            framenum;
     unsigned            start_time;
     bool                eof;
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;           // wakes up decoder thread
+    pthread_cond_t      ready_cond;     // wakes up main thread
+    pthread_t           thread;
+    bool                thread_started;
+    bool                terminate;
+    int                 error;
+    char                errmsg[MAX_STRING_CHARS];
 } cinematic_t;
 
 static cinematic_t  cin;
@@ -147,6 +174,8 @@ void SCR_InitCinematics(void)
 }
 
 static void packet_queue_destroy(PacketQueue *q);
+static void frame_queue_destroy(FrameQueue *q);
+static void stop_decode_thread(void);
 
 /*
 ==================
@@ -155,6 +184,8 @@ SCR_StopCinematic
 */
 void SCR_StopCinematic(void)
 {
+    stop_decode_thread();
+
     if (cin.video.frame)
         R_UpdateRawPic(0, 0, NULL);
 
@@ -174,6 +205,9 @@ void SCR_StopCinematic(void)
     packet_queue_destroy(&cin.video.queue);
     packet_queue_destroy(&cin.audio.queue);
 
+    frame_queue_destroy(&cin.video.ready);
+    frame_queue_destroy(&cin.audio.ready);
+
     memset(&cin, 0, sizeof(cin));
 }
 
@@ -254,79 +288,156 @@ static void packet_queue_destroy(PacketQueue *q)
     av_fifo_freep2(&q->pkt_list);
 }
 
-static int process_video(int frames)
+static int frame_queue_init(FrameQueue *q, const AVFrame *src, int size)
 {
-    AVFrame *in = cin.frame;
-    AVFrame *out = cin.video.frame;
+    AVFrame *out;
     int ret;
 
-    if (frames > 1)
-        Com_DPrintf("Dropped %d video frames\n", frames - 1);
+    Q_assert(size <= MAX_FRAMES);
 
-    if (in->width != cin.width || in->height != cin.height || in->format != cin.pix_fmt) {
-        Com_EPrintf("Video parameters changed\n");
-        return AVERROR_INPUT_CHANGED;
+    for (q->size = 0; q->size < size; q->size++) {
+        q->frames[q->size] = out = av_frame_alloc();
+        if (!out)
+            return AVERROR(ENOMEM);
+
+        out->width = src->width;
+        out->height = src->height;
+        out->format = src->format;
+        out->sample_rate = src->sample_rate;
+        out->nb_samples = src->nb_samples;
+
+        ret = av_channel_layout_copy(&out->ch_layout, &src->ch_layout);
+        if (ret < 0)
+            return ret;
+
+        ret = av_frame_get_buffer(out, 0);
+        if (ret < 0)
+            return ret;
     }
 
-    ret = sws_scale_frame(cin.sws_ctx, out, in);
-    if (ret < 0) {
-        Com_EPrintf("Error scaling video: %s\n", av_err2str(ret));
-        return ret;
+    return 0;
+}
+
+static void frame_queue_destroy(FrameQueue *q)
+{
+    for (int i = 0; i < MAX_FRAMES; i++)
+        av_frame_free(&q->frames[i]);
+}
+
+// main thread may pop frames concurrently, so take the lock
+static AVFrame *frame_queue_tail(FrameQueue *q)
+{
+    AVFrame *frame;
+
+    pthread_mutex_lock(&cin.lock);
+    frame = q->frames[(q->head + q->count) % q->size];
+    pthread_mutex_unlock(&cin.lock);
+
+    return frame;
+}
+
+static void frame_queue_pop(FrameQueue *q)
+{
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+}
+
+/*
+=============================================================================
+
+DECODER THREAD
+
+=============================================================================
+*/
+
+// can't print from decoder thread, save first error for main thread
+q_printf(2, 3)
+static int decode_error(int ret, const char *fmt, ...)
+{
+    va_list argptr;
+
+    pthread_mutex_lock(&cin.lock);
+    if (!cin.errmsg[0]) {
+        va_start(argptr, fmt);
+        Q_vsnprintf(cin.errmsg, sizeof(cin.errmsg), fmt, argptr);
+        va_end(argptr);
     }
+    pthread_mutex_unlock(&cin.lock);
 
-    cin.crop = (cin.info && cin.framenum >= cin.info->start) ? cin.info->crop * 2 : 0;
-    cin.framenum += frames;
+    return ret;
+}
+
+// makes tail frame of ready queue visible to main thread
+static void queue_frame(DecoderState *s)
+{
+    FrameQueue *q = &s->ready;
+
+    pthread_mutex_lock(&cin.lock);
+    q->timestamps[(q->head + q->count) % q->size] = s->decoded;
+    q->count++;
+    pthread_mutex_unlock(&cin.lock);
 
-    R_UpdateRawPic(cin.width, cin.height, (uint32_t *)out->data[0]);
+    pthread_cond_signal(&cin.ready_cond);
+}
+
+static int process_video(DecoderState *s)
+{
+    AVFrame *in = cin.frame;
+    AVFrame *out = frame_queue_tail(&s->ready);
+    int ret;
+
+    if (in->width != cin.width || in->height != cin.height || in->format != cin.pix_fmt)
+        return decode_error(AVERROR_INPUT_CHANGED, "Video parameters changed");
+
+    ret = sws_scale_frame(cin.sws_ctx, out, in);
+    if (ret < 0)
+        return decode_error(ret, "Error scaling video: %s", av_err2str(ret));
+
+    queue_frame(s);
     return 0;
 }
 
-static int process_audio(void)
+static int process_audio(DecoderState *s, AVFrame *in)
 {
-    AVFrame *in = cin.audio.eof ? NULL : cin.frame;
-    AVFrame *out = cin.audio.frame;
+    AVFrame *out = frame_queue_tail(&s->ready);
     int ret;
 
     out->nb_samples = MAX_RAW_SAMPLES;
     ret = swr_convert_frame(cin.swr_ctx, out, in);
-    if (ret < 0) {
-        Com_EPrintf("Error converting audio: %s\n", av_err2str(ret));
-        return ret;
-    }
+    if (ret < 0)
+        return decode_error(ret, "Error converting audio: %s", av_err2str(ret));
 
-    if (out->nb_samples)
-        S_RawSamples(out->nb_samples, out->sample_rate,
-                     av_get_bytes_per_sample(out->format),
-                     out->ch_layout.nb_channels, out->data[0]);
+    queue_frame(s);
     return 0;
 }
 
-static int decode_frames(DecoderState *s)
+// decodes and converts at most one frame, caller must ensure there is free
+// space in ready queue
+static int decode_frame(DecoderState *s)
 {
     AVFrame *frame = cin.frame;
     AVPacket *pkt = cin.pkt;
     AVCodecContext *dec = s->dec_ctx;
-    int ret, video_frames = 0;
-
-    if (!dec || s->eof)
-        return 0;
+    int ret;
 
     // naive decoding loop:
-    // - keep reading frames until PTS >= current time
     // - assume PTS starts at 0 and monotonically increases
     // - no A/V synchronization
-    while (s->timestamp < cls.realtime - cin.start_time) {
+    while (1) {
         ret = avcodec_receive_frame(dec, frame);
         if (ret == AVERROR_EOF) {
-            Com_DPrintf("%s from %s decoder\n", av_err2str(ret),
-                        av_get_media_type_string(dec->codec->type));
-            s->eof = true;
+            // flush swr
             if (dec->codec->type == AVMEDIA_TYPE_AUDIO) {
-                // flush swr
-                ret = process_audio();
+                ret = process_audio(s, NULL);
                 if (ret < 0)
                     return ret;
             }
+
+            pthread_mutex_lock(&cin.lock);
+            s->eof = true;
+            pthread_mutex_unlock(&cin.lock);
+
+            pthread_cond_signal(&cin.ready_cond);
             return 0;
         }
 
@@ -345,39 +456,25 @@ static int decode_frames(DecoderState *s)
                 ret = avcodec_send_packet(dec, pkt);
                 av_packet_unref(pkt);
             }
-            if (ret < 0) {
-                Com_EPrintf("Error submitting %s packet for decoding: %s\n",
-                            av_get_media_type_string(dec->codec->type), av_err2str(ret));
-                return ret;
-            }
+            if (ret < 0)
+                return decode_error(ret, "Error submitting %s packet for decoding: %s",
+                                    av_get_media_type_string(dec->codec->type), av_err2str(ret));
 
             continue;
         }
 
-        if (ret < 0) {
-            Com_EPrintf("Error during decoding %s: %s\n",
-                        av_get_media_type_string(dec->codec->type), av_err2str(ret));
-            return ret;
-        }
+        if (ret < 0)
+            return decode_error(ret, "Error during decoding %s: %s",
+                                av_get_media_type_string(dec->codec->type), av_err2str(ret));
 
         // ignore AV_NOPTS_VALUE, etc
         if (frame->pts > 0)
-            s->timestamp = av_rescale(frame->pts, dec->pkt_timebase.num * 1000LL, dec->pkt_timebase.den);
+            s->decoded = av_rescale(frame->pts, dec->pkt_timebase.num * 1000LL, dec->pkt_timebase.den);
 
-        // drop video if we can't keep up, but never drop audio
-        if (dec->codec->type == AVMEDIA_TYPE_VIDEO) {
-            video_frames++;
-        } else {
-            ret = process_audio();
-            if (ret < 0)
-                return ret;
-        }
+        if (dec->codec->type == AVMEDIA_TYPE_VIDEO)
+            return process_video(s);
+        return process_audio(s, frame);
     }
-
-    if (video_frames)
-        return process_video(video_frames);
-
-    return 0;
 }
 
 // buffer 1.5 seconds worth of packets
@@ -391,36 +488,29 @@ static int min_duration(const AVCodecContext *dec)
     return 0;
 }
 
-static bool need_more_packets(void)
+static bool need_more_packets(const DecoderState *s)
 {
     return
+        !s->queue.nb_packets ||
         cin.video.queue.duration < min_duration(cin.video.dec_ctx) ||
         cin.audio.queue.duration < min_duration(cin.audio.dec_ctx);
 }
 
-/*
-==================
-SCR_ReadNextFrame
-==================
-*/
-static bool SCR_ReadNextFrame(void)
+static int read_packets(const DecoderState *s)
 {
     AVPacket *pkt = cin.pkt;
     int ret;
 
     // read frames from the file
-    while (!cin.eof && need_more_packets()) {
+    while (!cin.eof && need_more_packets(s)) {
         ret = av_read_frame(cin.fmt_ctx, pkt);
         // idcin demuxer returns AVERROR(EIO) on EOF packet...
         if (ret == AVERROR_EOF || ret == AVERROR(EIO)) {
-            Com_DPrintf("%s from demuxer\n", av_err2str(ret));
             cin.eof = true;
             break;
         }
-        if (ret < 0) {
-            Com_EPrintf("Error reading packet: %s\n", av_err2str(ret));
-            return false;
-        }
+        if (ret < 0)
+            return decode_error(ret, "Error reading packet: %s", av_err2str(ret));
 
         // check if the packet belongs to a stream we are interested in,
         // otherwise skip it
@@ -430,17 +520,186 @@ static bool SCR_ReadNextFrame(void)
             ret = packet_queue_put(&cin.audio.queue, pkt);
         else
             av_packet_unref(pkt);
+        if (ret < 0)
+            return decode_error(ret, "Failed to queue packet");
+    }
+
+    return 0;
+}
+
+static bool can_decode(const DecoderState *s)
+{
+    return s->dec_ctx && !s->eof && s->ready.count < s->ready.size;
+}
+
+static int decode_step(DecoderState *s)
+{
+    int ret = read_packets(s);
+    if (ret < 0)
+        return ret;
+    return decode_frame(s);
+}
+
+static void *decode_thread(void *arg)
+{
+    bool video, audio;
+    int ret = 0;
+
+    pthread_mutex_lock(&cin.lock);
+    while (!cin.terminate) {
+        video = can_decode(&cin.video);
+        audio = can_decode(&cin.audio);
+        if (!video && !audio) {
+            pthread_cond_wait(&cin.cond, &cin.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&cin.lock);
+
+        if (video)
+            ret = decode_step(&cin.video);
+        if (ret >= 0 && audio)
+            ret = decode_step(&cin.audio);
+
+        pthread_mutex_lock(&cin.lock);
         if (ret < 0) {
-            Com_EPrintf("Failed to queue packet\n");
-            return false;
+            cin.error = ret;
+            break;
         }
     }
+    pthread_mutex_unlock(&cin.lock);
 
-    if (decode_frames(&cin.video) < 0)
+    pthread_cond_signal(&cin.ready_cond);
+    return NULL;
+}
+
+static bool start_decode_thread(void)
+{
+    pthread_mutex_init(&cin.lock, NULL);
+    pthread_cond_init(&cin.cond, NULL);
+    pthread_cond_init(&cin.ready_cond, NULL);
+
+    if (pthread_create(&cin.thread, NULL, decode_thread, NULL)) {
+        Com_EPrintf("Couldn't create decoder thread\n");
+        pthread_mutex_destroy(&cin.lock);
+        pthread_cond_destroy(&cin.cond);
+        pthread_cond_destroy(&cin.ready_cond);
         return false;
-    if (decode_frames(&cin.audio) < 0)
+    }
+
+    cin.thread_started = true;
+
+    // wait for the first frame, so that there is something to draw
+    pthread_mutex_lock(&cin.lock);
+    while (!cin.video.ready.count && !cin.video.eof && !cin.error)
+        pthread_cond_wait(&cin.ready_cond, &cin.lock);
+    pthread_mutex_unlock(&cin.lock);
+
+    return true;
+}
+
+static void stop_decode_thread(void)
+{
+    if (!cin.thread_started)
+        return;
+
+    pthread_mutex_lock(&cin.lock);
+    cin.terminate = true;
+    pthread_mutex_unlock(&cin.lock);
+
+    pthread_cond_signal(&cin.cond);
+
+    Q_assert(!pthread_join(cin.thread, NULL));
+
+    pthread_mutex_destroy(&cin.lock);
+    pthread_cond_destroy(&cin.cond);
+    pthread_cond_destroy(&cin.ready_cond);
+    cin.thread_started = false;
+}
+
+/*
+=============================================================================
+
+MAIN THREAD
+
+=============================================================================
+*/
+
+static void present_video(int frames)
+{
+    if (frames > 1)
+        Com_DPrintf("Dropped %d video frames\n", frames - 1);
+
+    cin.crop = (cin.info && cin.framenum >= cin.info->start) ? cin.info->crop * 2 : 0;
+    cin.framenum += frames;
+
+    R_UpdateRawPic(cin.width, cin.height, (uint32_t *)cin.video.frame->data[0]);
+}
+
+static void present_audio(const AVFrame *out)
+{
+    if (out->nb_samples)
+        S_RawSamples(out->nb_samples, out->sample_rate,
+                     av_get_bytes_per_sample(out->format),
+                     out->ch_layout.nb_channels, out->data[0]);
+}
+
+/*
+==================
+SCR_ReadNextFrame
+
+Takes all frames that are due from decoder thread. Keeps taking frames
+until PTS >= current time.
+==================
+*/
+static bool SCR_ReadNextFrame(void)
+{
+    FrameQueue *q;
+    AVFrame *frame;
+    unsigned now = cls.realtime - cin.start_time;
+    int video_frames = 0, audio_frames = 0;
+    int error;
+
+    pthread_mutex_lock(&cin.lock);
+
+    // drop video if we can't keep up, but never drop audio.
+    // swap with current frame instead of copying, decoder will reuse it.
+    q = &cin.video.ready;
+    while (cin.video.timestamp < now && q->count) {
+        frame = q->frames[q->head];
+        q->frames[q->head] = cin.video.frame;
+        cin.video.frame = frame;
+        cin.video.timestamp = q->timestamps[q->head];
+        frame_queue_pop(q);
+        video_frames++;
+    }
+
+    q = &cin.audio.ready;
+    while (cin.audio.timestamp < now && q->count) {
+        present_audio(q->frames[q->head]);
+        cin.audio.timestamp = q->timestamps[q->head];
+        frame_queue_pop(q);
+        audio_frames++;
+    }
+
+    cin.video.done = cin.video.eof && !cin.video.ready.count && cin.video.timestamp < now;
+    cin.audio.done = cin.audio.eof && !cin.audio.ready.count && cin.audio.timestamp < now;
+
+    error = cin.error;
+
+    pthread_mutex_unlock(&cin.lock);
+
+    if (video_frames || audio_frames)
+        pthread_cond_signal(&cin.cond);
+
+    if (error < 0) {
+        Com_EPrintf("%s\n", cin.errmsg);
         return false;
-    if (cin.video.eof && cin.audio.eof)
+    }
+
+    if (video_frames)
+        present_video(video_frames);
+
+    if (cin.video.done && cin.audio.done)
         return false;
 
     return true;
@@ -480,7 +739,7 @@ void SCR_DrawCinematic(void)
 {
     R_DrawFill8(0, 0, r_config.width, r_config.height, 0);
 
-    if (cin.width > 0 && cin.height > cin.crop && !cin.video.eof) {
+    if (cin.width > 0 && cin.height > cin.crop && !cin.video.done) {
         float scale_w = (float)r_config.width / cin.width;
         float scale_h = (float)r_config.height / (cin.height - cin.crop);
         float scale = min(scale_w, scale_h);
@@ -538,6 +797,10 @@ static bool open_codec_context(enum AVMediaType type)
         return false;
     }
 
+    // let libavcodec decode using multiple threads as well
+    dec_ctx->thread_count = 0;
+    dec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
     ret = avcodec_open2(dec_ctx, dec, NULL);
     if (ret < 0) {
         Com_EPrintf("Failed to open %s codec\n", av_get_media_type_string(type));
@@ -578,6 +841,12 @@ static bool open_codec_context(enum AVMediaType type)
             return false;
         }
 
+        ret = frame_queue_init(&cin.video.ready, out, VIDEO_FRAMES);
+        if (ret < 0) {
+            Com_EPrintf("Failed to allocate video frame queue\n");
+            return false;
+        }
+
         cin.video.queue.pkt_list = av_fifo_alloc2(1, sizeof(AVPacket *), AV_FIFO_FLAG_AUTO_GROW);
         if (!cin.video.queue.pkt_list) {
             Com_EPrintf("Failed to allocate video packet queue\n");
@@ -617,6 +886,12 @@ static bool open_codec_context(enum AVMediaType type)
             return false;
         }
 
+        ret = frame_queue_init(&cin.audio.ready, out, AUDIO_FRAMES);
+        if (ret < 0) {
+            Com_EPrintf("Failed to allocate audio frame queue\n");
+            return false;
+        }
+
         cin.audio.queue.pkt_list = av_fifo_alloc2(1, sizeof(AVPacket *), AV_FIFO_FLAG_AUTO_GROW);
         if (!cin.audio.queue.pkt_list) {
             Com_EPrintf("Failed to allocate audio packet queue\n");
@@ -721,6 +996,9 @@ done:
         }
     }
 
+    if (!start_decode_thread())
+        return false;
+
     return SCR_ReadNextFrame();
 }
 
@@ -847,9 +847,7 @@ void CL_Trace(trace_t *tr, const vec3_t start, const vec3_t end, const vec3_t mi
 #define PARTICLE_GRAVITY    40
 #define INSTANT_PARTICLE    -10000.0f
 
-typedef struct cparticle_s {
-    struct cparticle_s    *next;
-
+typedef struct {
     int     time;
     vec3_t  org;
     vec3_t  vel;
@@ -899,8 +897,10 @@ void CL_TeleporterParticles(const vec3_t org);
 void CL_TeleportParticles(const vec3_t org);
 void CL_ParticleEffect(const vec3_t org, const vec3_t dir, int color, int count);
 void CL_ParticleEffect2(const vec3_t org, const vec3_t dir, int color, int count);
+void CL_ClearParticles(void);
 cparticle_t *CL_AllocParticle(void);
 void CL_AddParticles(void);
+int CL_NumParticles(void);
 cdlight_t *CL_AllocDlight(int key);
 void CL_AddDLights(void);
 void CL_SetLightStyle(int index, const char *s);
@@ -586,8 +586,8 @@ If no console is visible, the text will appear at the top of the game window
 */
 void Con_Print(const char *txt)
 {
-    char *p;
-    int l;
+    const char *p;
+    int l, n;
 
     if (!con.initialized)
         return;
@@ -602,31 +602,32 @@ void Con_Print(const char *txt)
             con.newline = 0;
         }
 
-        // count word length
-        for (p = (char *)txt; *p > 32; p++)
+        if (*txt == '\r' || *txt == '\n') {
+            con.newline = *txt++;
+            continue;
+        }
+
+        // count word length, anything else is appended one char at a time
+        for (p = txt; *p > 32; p++)
             ;
-        l = p - txt;
+        l = max(p - txt, 1);
 
         // word wrap
         if (l < con.linewidth && con.x + l > con.linewidth) {
             Con_Linefeed();
         }
 
-        switch (*txt) {
-        case '\r':
-        case '\n':
-            con.newline = *txt;
-            break;
-        default:    // display character and advance
-            if (con.x == con.linewidth) {
+        // copy the whole word at once, splitting it if longer than a line
+        while (l > 0) {
+            if (con.x >= con.linewidth) {
                 Con_Linefeed();
             }
-            p = con.text[con.current & CON_TOTALLINES_MASK].text;
-            p[con.x++] = *txt;
-            break;
+            n = max(min(l, con.linewidth - con.x), 1);
+            memcpy(con.text[con.current & CON_TOTALLINES_MASK].text + con.x, txt, n);
+            con.x += n;
+            txt += n;
+            l -= n;
         }
-
-        txt++;
     }
 
     // update time for transparent overlay
@@ -697,6 +698,10 @@ static int Con_DrawLine(int v, int row, float alpha, bool notify)
     int x = CONCHAR_WIDTH;
     int w = con.linewidth;
 
+    // don't touch color state for blank lines
+    if (!*s)
+        return x;
+
     if (notify) {
         s += line->ts_len;
     } else if (line->ts_len) {
@@ -900,33 +900,42 @@ PARTICLE MANAGEMENT
 ==============================================================
 */
 
-static cparticle_t  *active_particles, *free_particles;
-
 static cparticle_t  particles[MAX_PARTICLES];
+static int          num_particles;
+static cparticle_t  dropped_particle;   // filled in and thrown away
+
+static cvar_t   *cl_maxparticles;
 
-static void CL_ClearParticles(void)
+void CL_ClearParticles(void)
 {
-    int     i;
+    num_particles = 0;
+}
 
-    free_particles = &particles[0];
-    active_particles = NULL;
+/*
+===============
+CL_AllocParticle
 
-    for (i = 0; i < MAX_PARTICLES - 1; i++)
-        particles[i].next = &particles[i + 1];
-    particles[i].next = NULL;
-}
+Particles are kept densely packed in the array and removed by swapping the
+last one into the hole. When the pool gets more than 3/4 full, new
+particles are randomly dropped with increasing probability, so that heavy
+fights thin effects out rather than losing whole effects at the limit.
 
+Dropped particles are returned as a scratch particle that is never added
+to the pool, so spawners keep going. NULL means the pool is full.
+===============
+*/
 cparticle_t *CL_AllocParticle(void)
 {
     cparticle_t *p;
+    int limit = cl_maxparticles->integer;
+    int soft = limit - limit / 4;
 
-    if (!free_particles)
+    if (num_particles >= limit)
         return NULL;
-    p = free_particles;
-    free_particles = p->next;
-    p->next = active_particles;
-    active_particles = p;
+    if (num_particles >= soft && Q_rand() % (limit - soft) < num_particles - soft)
+        return &dropped_particle;
 
+    p = &particles[num_particles++];
     p->scale = 1.0f;
     return p;
 }
@@ -1738,48 +1747,54 @@ extern particle_t   r_particles[MAX_PARTICLES];
 /*
 ===============
 CL_AddParticles
+
+If the pool is over the soft limit, faintest particles are culled first.
+Particles that don't fit into the scene are still simulated.
 ===============
 */
 void CL_AddParticles(void)
 {
-    cparticle_t     *p, *next;
-    float           alpha;
+    cparticle_t     *p;
+    float           alpha, cull;
     float           time, time2;
-    cparticle_t     *active, *tail;
     particle_t      *part;
+    int             i, limit, soft;
 
-    active = NULL;
-    tail = NULL;
+    limit = cl_maxparticles->integer;
+    soft = limit - limit / 4;
+    if (num_particles > soft)
+        cull = (float)(num_particles - soft) / (limit - soft) * 0.25f;
+    else
+        cull = 0.0f;
 
-    for (p = active_particles; p; p = next) {
-        next = p->next;
+    for (i = 0; i < num_particles;) {
+        p = &particles[i];
 
         if (p->alphavel != INSTANT_PARTICLE) {
             time = (cl.time - p->time) * 0.001f;
             alpha = p->alpha + time * p->alphavel;
-            if (alpha <= 0) {
-                // faded out
-                p->next = free_particles;
-                free_particles = p;
-                continue;
-            }
         } else {
             time = 0.0f;
             alpha = p->alpha;
         }
 
-        if (r_numparticles >= MAX_PARTICLES)
-            break;
-        part = &r_particles[r_numparticles++];
+        if (alpha <= cull) {
+            // faded out or culled
+            *p = particles[--num_particles];
+            continue;
+        }
+
+        i++;
 
-        p->next = NULL;
-        if (!tail)
-            active = tail = p;
-        else {
-            tail->next = p;
-            tail = p;
+        if (p->alphavel == INSTANT_PARTICLE) {
+            p->alphavel = 0.0f;
+            p->alpha = 0.0f;
         }
 
+        if (r_numparticles >= MAX_PARTICLES)
+            continue;
+        part = &r_particles[r_numparticles++];
+
         time2 = time * time;
 
         part->origin[0] = p->org[0] + p->vel[0] * time + p->accel[0] * time2;
@@ -1790,14 +1805,12 @@ void CL_AddParticles(void)
         part->color = p->color;
         part->alpha = min(alpha, 1.0f);
         part->scale = p->scale;
-
-        if (p->alphavel == INSTANT_PARTICLE) {
-            p->alphavel = 0.0f;
-            p->alpha = 0.0f;
-        }
     }
+}
 
-    active_particles = active;
+int CL_NumParticles(void)
+{
+    return num_particles;
 }
 
 
@@ -1814,6 +1827,13 @@ void CL_ClearEffects(void)
     CL_ClearDlights();
 }
 
+static void cl_maxparticles_changed(cvar_t *self)
+{
+    Cvar_ClampInteger(self, 1024, MAX_PARTICLES);
+    if (num_particles > self->integer)
+        num_particles = self->integer;
+}
+
 void CL_InitEffects(void)
 {
     int i, j;
@@ -1824,4 +1844,7 @@ void CL_InitEffects(void)
 
     cl_lerp_lightstyles = Cvar_Get("cl_lerp_lightstyles", "0", 0);
     cl_muzzlelight_time = Cvar_Get("cl_muzzlelight_time", "16", 0);
+    cl_maxparticles = Cvar_Get("cl_maxparticles", "8192", 0);
+    cl_maxparticles->changed = cl_maxparticles_changed;
+    cl_maxparticles_changed(cl_maxparticles);
 }
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "sound.h"
 #include "common/intreadwrite.h"
+#include "system/pthread.h"
 
 #define PAINTBUFFER_SIZE    2048
 
@@ -34,9 +35,21 @@ cvar_t      *s_khz;
 static cvar_t       *s_testsound;
 static cvar_t       *s_swapstereo;
 static cvar_t       *s_mixahead;
+static cvar_t       *s_mixthread;
 
 static float    snd_vol;
 
+// mixer thread state, protected by mix.lock while thread is running
+static struct {
+    bool            started;
+    bool            terminate;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    float           mixahead;   // seconds to mix ahead
+    bool            underwater;
+    int             overflows;
+} mix;
+
 static int          s_rawend;
 static samplepair_t s_rawsamples[MAX_RAW_SAMPLES];
 
@@ -99,6 +112,26 @@ static void DMA_PageInSfx(sfx_t *sfx)
 /*
 ===============================================================================
 
+MIXER LOCKING
+
+===============================================================================
+*/
+
+static void DMA_Lock(void)
+{
+    if (mix.started)
+        pthread_mutex_lock(&mix.lock);
+}
+
+static void DMA_Unlock(void)
+{
+    if (mix.started)
+        pthread_mutex_unlock(&mix.lock);
+}
+
+/*
+===============================================================================
+
 RAW SAMPLES
 
 ===============================================================================
@@ -116,6 +149,8 @@ static bool DMA_RawSamples(int samples, int rate, int width, int channels, const
     int outcount = samples / stepscale;
     float vol = snd_vol * volume;
 
+    DMA_Lock();
+
     if (s_rawend < s_paintedtime)
         s_rawend = s_paintedtime;
 
@@ -163,6 +198,8 @@ static bool DMA_RawSamples(int samples, int rate, int width, int channels, const
     }
 
     s_rawend += outcount;
+
+    DMA_Unlock();
     return true;
 }
 
@@ -170,7 +207,10 @@ static bool DMA_RawSamples(int samples, int rate, int width, int channels, const
 
 static int DMA_HaveRawSamples(void)
 {
-    return Q_clip(s_rawend - s_paintedtime, 0, MAX_RAW_SAMPLES);
+    DMA_Lock();
+    int have = Q_clip(s_rawend - s_paintedtime, 0, MAX_RAW_SAMPLES);
+    DMA_Unlock();
+    return have;
 }
 
 static int DMA_NeedRawSamples(void)
@@ -180,8 +220,10 @@ static int DMA_NeedRawSamples(void)
 
 static void DMA_DropRawSamples(void)
 {
+    DMA_Lock();
     memset(s_rawsamples, 0, sizeof(s_rawsamples));
     s_rawend = s_paintedtime;
+    DMA_Unlock();
 }
 
 /*
@@ -427,14 +469,13 @@ static void PaintChannels(int endtime)
     samplepair_t paintbuffer[PAINTBUFFER_SIZE];
     channel_t *ch;
     int i;
-    bool underwater = S_IsUnderWater();
 
     while (s_paintedtime < endtime) {
         // if paintbuffer is smaller than DMA buffer
         int end = min(endtime, s_paintedtime + PAINTBUFFER_SIZE);
 
-        // start any playsounds
-        while (1) {
+        // start any playsounds, mixer thread leaves this to DMA_Update
+        while (!mix.started) {
             playsound_t *ps = PS_FIRST(&s_pendingplays);
             if (PS_TERM(ps, &s_pendingplays))
                 break;    // no more pending sounds
@@ -456,7 +497,8 @@ static void PaintChannels(int endtime)
                 if (!ch->sfx || (!ch->leftvol && !ch->rightvol))
                     break;
 
-                sfxcache_t *sc = S_LoadSound(ch->sfx);
+                // may be running on mixer thread, never load here
+                sfxcache_t *sc = ch->sfx->cache;
                 if (!sc)
                     break;
 
@@ -488,7 +530,7 @@ static void PaintChannels(int endtime)
             }
         }
 
-        if (underwater)
+        if (mix.underwater)
             underwater_filter(paintbuffer, end - s_paintedtime);
 
         // add from the streaming sound source
@@ -550,6 +592,55 @@ static void DMA_SoundInfo(void)
     Com_Printf("%5d submission_chunk\n", dma.submission_chunk);
     Com_Printf("%5d speed\n", dma.speed);
     Com_Printf("%p dma buffer\n", dma.buffer);
+    Com_Printf("%5s mixer thread\n", mix.started ? "yes" : "no");
+    Com_Printf("%5d overflows\n", mix.overflows);
+}
+
+static void DMA_Paint(void);
+
+static void *mix_func(void *arg)
+{
+    pthread_mutex_lock(&mix.lock);
+    while (!mix.terminate) {
+        DMA_Paint();
+
+        // wake up often enough to keep a few periods queued
+        int msec = Q_clip(mix.mixahead * 250, 1, 20);
+
+        pthread_mutex_unlock(&mix.lock);
+        Sys_Sleep(msec);
+        pthread_mutex_lock(&mix.lock);
+    }
+    pthread_mutex_unlock(&mix.lock);
+
+    return NULL;
+}
+
+static void DMA_StartMixer(void)
+{
+    mix.terminate = false;
+    mix.mixahead = Cvar_ClampValue(s_mixahead, 0, 1);
+    pthread_mutex_init(&mix.lock, NULL);
+    if (pthread_create(&mix.thread, NULL, mix_func, NULL)) {
+        Com_EPrintf("Couldn't create mixer thread\n");
+        pthread_mutex_destroy(&mix.lock);
+        return;
+    }
+    mix.started = true;
+}
+
+static void DMA_StopMixer(void)
+{
+    if (!mix.started)
+        return;
+
+    pthread_mutex_lock(&mix.lock);
+    mix.terminate = true;
+    pthread_mutex_unlock(&mix.lock);
+
+    Q_assert(!pthread_join(mix.thread, NULL));
+    pthread_mutex_destroy(&mix.lock);
+    mix.started = false;
 }
 
 static bool DMA_Init(void)
@@ -559,6 +650,7 @@ static bool DMA_Init(void)
 
     s_khz = Cvar_Get("s_khz", "44", CVAR_ARCHIVE | CVAR_SOUND);
     s_mixahead = Cvar_Get("s_mixahead", "0.1", CVAR_ARCHIVE);
+    s_mixthread = Cvar_Get("s_mixthread", "0", CVAR_SOUND);
     s_testsound = Cvar_Get("s_testsound", "0", 0);
     s_swapstereo = Cvar_Get("s_swapstereo", "0", 0);
     cvar_t *s_driver = Cvar_Get("s_driver", "", CVAR_SOUND);
@@ -597,11 +689,23 @@ static bool DMA_Init(void)
 
     Com_Printf("sound sampling rate: %i\n", dma.speed);
 
+    mix.overflows = 0;
+    if (s_mixthread->integer) {
+        // other drivers print and shut down on errors from begin_painting
+        // and submit, which must only happen on main thread
+        if (snddma->threaded)
+            DMA_StartMixer();
+        else
+            Com_WPrintf("Mixer thread not supported by %s driver\n", snddma->name);
+    }
+
     return true;
 }
 
 static void DMA_Shutdown(void)
 {
+    DMA_StopMixer();
+
     snddma->shutdown();
     snddma = NULL;
     s_numchannels = 0;
@@ -614,7 +718,10 @@ static void DMA_Activate(void)
 {
     if (snddma->activate) {
         S_StopAllSounds();
+        // driver may recreate buffers mixer thread is painting into
+        DMA_Lock();
         snddma->activate(s_active);
+        DMA_Unlock();
     }
 }
 
@@ -776,7 +883,7 @@ static int DMA_GetTime(void)
             // time to chop things off to avoid 32 bit limits
             buffers = 0;
             s_rawend = s_paintedtime = fullsamples;
-            S_StopAllSounds();
+            S_ClearPlaysounds();
         }
     }
     oldsamplepos = dma.samplepos;
@@ -784,13 +891,68 @@ static int DMA_GetTime(void)
     return buffers * fullsamples + (dma.samplepos >> (dma.channels - 1));
 }
 
+static void DMA_Paint(void)
+{
+    int         samples, soundtime, endtime;
+
+    snddma->begin_painting();
+
+    if (!dma.buffer)
+        return;
+
+    // update DMA time
+    soundtime = DMA_GetTime();
+
+    // check to make sure that we haven't overshot
+    if (s_paintedtime < soundtime) {
+        if (!mix.started)
+            Com_DPrintf("%s: overflow\n", __func__);
+        mix.overflows++;
+        s_paintedtime = soundtime;
+    }
+
+    // mix ahead of current position
+    endtime = soundtime + mix.mixahead * dma.speed;
+
+    // mix to an even submission block size
+    endtime = Q_ALIGN(endtime, dma.submission_chunk);
+    samples = dma.samples >> (dma.channels - 1);
+    endtime = min(endtime, soundtime + samples);
+
+    PaintChannels(endtime);
+
+    snddma->submit();
+}
+
+/*
+=================
+DMA_IssuePlaysounds
+
+With mixer thread running, playsounds are started from the main thread, since
+that may need to load the sound, print and spatialize. Sounds that became due
+since last update are started late by at most a frame.
+=================
+*/
+static void DMA_IssuePlaysounds(void)
+{
+    while (1) {
+        playsound_t *ps = PS_FIRST(&s_pendingplays);
+        if (PS_TERM(ps, &s_pendingplays))
+            break;    // no more pending sounds
+        if (ps->begin > s_paintedtime)
+            break;
+        S_IssuePlaysound(ps);
+    }
+}
+
 static void DMA_Update(void)
 {
     int         i;
     channel_t   *ch;
-    int         samples, soundtime, endtime;
     float       sec;
 
+    DMA_Lock();
+
     // update spatialization for dynamic sounds
     for (i = 0, ch = s_channels; i < s_numchannels; i++, ch++) {
         if (!ch->sfx)
@@ -809,6 +971,9 @@ static void DMA_Update(void)
         }
     }
 
+    if (mix.started)
+        DMA_IssuePlaysounds();
+
     // add loopsounds
     AddLoopSounds();
 
@@ -827,34 +992,17 @@ static void DMA_Update(void)
     }
 #endif
 
-    snddma->begin_painting();
-
-    if (!dma.buffer)
-        return;
-
-    // update DMA time
-    soundtime = DMA_GetTime();
-
-    // check to make sure that we haven't overshot
-    if (s_paintedtime < soundtime) {
-        Com_DPrintf("%s: overflow\n", __func__);
-        s_paintedtime = soundtime;
-    }
-
-    // mix ahead of current position
+    // mixer thread only needs the parameters
     sec = Cvar_ClampValue(s_mixahead, 0, 1);
     if (!cls.active)
         sec = max(sec, 0.125f);
-    endtime = soundtime + sec * dma.speed;
-
-    // mix to an even submission block size
-    endtime = Q_ALIGN(endtime, dma.submission_chunk);
-    samples = dma.samples >> (dma.channels - 1);
-    endtime = min(endtime, soundtime + samples);
+    mix.mixahead = sec;
+    mix.underwater = S_IsUnderWater();
 
-    PaintChannels(endtime);
+    if (!mix.started)
+        DMA_Paint();
 
-    snddma->submit();
+    DMA_Unlock();
 }
 
 static int DMA_GetSampleRate(void)
@@ -878,4 +1026,6 @@ const sndapi_t snd_dma = {
     .play_channel = DMA_Spatialize,
     .stop_all_sounds = DMA_ClearBuffer,
     .get_sample_rate = DMA_GetSampleRate,
+    .lock = DMA_Lock,
+    .unlock = DMA_Unlock,
 };
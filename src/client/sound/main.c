@@ -688,10 +688,14 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
     if (!sc)
         return;     // couldn't load the sound's data
 
+    S_LockMixer();
+
     // make the playsound_t
     ps = S_AllocPlaysound();
-    if (!ps)
+    if (!ps) {
+        S_UnlockMixer();
         return;
+    }
 
     if (origin) {
         VectorCopy(origin, ps->origin);
@@ -713,6 +717,8 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
             break;
 
     List_Append(&sort->entry, &ps->entry);
+
+    S_UnlockMixer();
 }
 
 void S_ParseStartSound(void)
@@ -760,11 +766,25 @@ S_StopAllSounds
 */
 void S_StopAllSounds(void)
 {
-    int     i;
-
     if (!s_started)
         return;
 
+    S_LockMixer();
+    S_ClearPlaysounds();
+    S_UnlockMixer();
+}
+
+/*
+==================
+S_ClearPlaysounds
+
+Same as S_StopAllSounds, but mixer must be already locked.
+==================
+*/
+void S_ClearPlaysounds(void)
+{
+    int     i;
+
     // clear all the playsounds
     memset(s_playsounds, 0, sizeof(s_playsounds));
 
@@ -127,6 +127,8 @@ typedef struct {
     void (*stop_channel)(channel_t *ch);
     void (*stop_all_sounds)(void);
     int (*get_sample_rate)(void);
+    void (*lock)(void);
+    void (*unlock)(void);
 } sndapi_t;
 
 #if USE_SNDDMA
@@ -184,9 +186,23 @@ extern cvar_t       *s_underwater_gain_hf;
 #define S_GetEntityLoopDistMult(ent)    Com_GetEntityLoopDistMult((ent)->loop_attenuation)
 #define S_GetEntityLoopStereoPan(ent)   !(cl.csr.extended && (ent)->renderfx & RF_NO_STEREO)
 
+// backends that mix on a separate thread protect channels and playsounds
+static inline void S_LockMixer(void)
+{
+    if (s_api->lock)
+        s_api->lock();
+}
+
+static inline void S_UnlockMixer(void)
+{
+    if (s_api->unlock)
+        s_api->unlock();
+}
+
 sfx_t *S_SfxForHandle(qhandle_t hSfx);
 sfxcache_t *S_LoadSound(sfx_t *s);
 channel_t *S_PickChannel(int entnum, int entchannel);
 void S_IssuePlaysound(playsound_t *ps);
+void S_ClearPlaysounds(void);
 int S_BuildSoundList(int *sounds);
 void S_SpatializeOrigin(const vec3_t origin, float master_vol, float dist_mult, float *left_vol, float *right_vol, bool stereo);
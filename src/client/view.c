@@ -237,6 +237,67 @@ static void V_TestLights(void)
     }
 }
 
+/*
+================
+V_ParticleBench_f
+
+Simulates particles of a heavy fight without rendering anything.
+================
+*/
+static void V_ParticleBench_f(void)
+{
+    centity_t ent;
+    vec3_t org, dst;
+    int i, j, frames, oldtime, peak;
+    unsigned start, end;
+
+    frames = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 1000;
+    if (frames < 1) {
+        Com_Printf("Usage: %s [frames]\n", Cmd_Argv(0));
+        return;
+    }
+
+    oldtime = cl.time;
+    CL_ClearParticles();
+
+    start = Sys_Milliseconds();
+
+    peak = 0;
+    for (i = 0; i < frames; i++) {
+        cl.time += 16;
+
+        for (j = 0; j < 4; j++) {
+            VectorSet(org, crand() * 512, crand() * 512, crand() * 128);
+            VectorSet(dst, crand() * 512, crand() * 512, crand() * 128);
+
+            if (!(i & 7)) {
+                CL_ExplosionParticles(org);
+                CL_BFGExplosionParticles(dst);
+            }
+
+            memset(&ent, 0, sizeof(ent));
+            ent.trailcount = 1024;
+            VectorCopy(org, ent.lerp_origin);
+            CL_DiminishingTrail(&ent, dst, DT_ROCKET);
+            CL_BubbleTrail(org, dst);
+        }
+
+        r_numparticles = 0;
+        CL_AddParticles();
+
+        peak = max(peak, CL_NumParticles());
+    }
+
+    end = Sys_Milliseconds();
+
+    CL_ClearParticles();
+    r_numparticles = 0;
+    cl.time = oldtime;
+
+    Com_Printf("%d msec, %d frames, %d peak particles\n",
+               end - start, frames, peak);
+}
+
 #endif
 
 //===================================================================
@@ -548,6 +609,9 @@ static const cmdreg_t v_cmds[] = {
     { "gun_model", V_Gun_Model_f },
     { "viewpos", V_Viewpos_f },
     { "fog", V_Fog_f },
+#if USE_DEBUG
+    { "particlebench", V_ParticleBench_f },
+#endif
     { NULL }
 };
 
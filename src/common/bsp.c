@@ -32,6 +32,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/sizebuf.h"
 #include "common/utils.h"
 #include "system/hunk.h"
+#include "system/pthread.h"
+#include "system/system.h"
 
 extern mtexinfo_t nulltexinfo;
 
@@ -739,14 +741,62 @@ static void BSP_MergeLeafContents(bsp_t *bsp)
             leaf->contents[1] |= leaf->firstleafbrush[j]->contents;
 }
 
-/*
-==================
-BSP_Load
+// don't bother with a thread for small maps
+#define BSP_THREAD_MIN  0x100000
 
-Loads in the map and all submodels
-==================
-*/
-int BSP_Load(const char *name, bsp_t **bsp_p)
+typedef struct {
+    const byte  *buf;
+    size_t      len;
+    uint32_t    checksum;
+    uint64_t    time;
+    pthread_t   thread;
+    bool        started;
+} bsp_checksum_t;
+
+// timings of the last uncached load, in microseconds
+static struct {
+    uint64_t    read;
+    uint64_t    checksum;
+    uint64_t    lumps;
+    uint64_t    validate;
+    uint64_t    total;
+    bool        threaded;
+} bsp_time;
+
+static void *BSP_ChecksumThread(void *arg)
+{
+    bsp_checksum_t *c = arg;
+    uint64_t start = Sys_Microseconds();
+
+    c->checksum = Com_BlockChecksum(c->buf, c->len);
+    c->time = Sys_Microseconds() - start;
+    return NULL;
+}
+
+// checksum doesn't depend on anything, so calculate it on a separate thread
+// while lumps are being loaded. it only reads the file buffer.
+static void BSP_StartChecksum(bsp_checksum_t *c, const byte *buf, size_t len)
+{
+    c->buf = buf;
+    c->len = len;
+    c->started = len >= BSP_THREAD_MIN &&
+        !pthread_create(&c->thread, NULL, BSP_ChecksumThread, c);
+}
+
+static uint32_t BSP_FinishChecksum(bsp_checksum_t *c)
+{
+    if (c->started)
+        Q_assert(!pthread_join(c->thread, NULL));
+    else
+        BSP_ChecksumThread(c);
+
+    bsp_time.checksum = c->time;
+    bsp_time.threaded = c->started;
+    return c->checksum;
+}
+
+// loads the map bypassing the cache
+static int BSP_LoadFile(const char *name, bsp_t **bsp_p)
 {
     bsp_t           *bsp;
     byte            *buf;
@@ -758,21 +808,10 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
     uint32_t        lump_count[q_countof(bsp_lumps)];
     size_t          memsize;
     bool            extended = false;
+    bsp_checksum_t  checksum;
+    uint64_t        start, time;
 
-    Q_assert(name);
-    Q_assert(bsp_p);
-
-    *bsp_p = NULL;
-
-    if (!*name)
-        return Q_ERR(ENOENT);
-
-    if ((bsp = BSP_Find(name)) != NULL) {
-        Com_PageInMemory(bsp->hunk.base, bsp->hunk.cursize);
-        bsp->refcount++;
-        *bsp_p = bsp;
-        return Q_ERR_SUCCESS;
-    }
+    start = time = Sys_Microseconds();
 
     //
     // load the file
@@ -782,6 +821,8 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
         return filelen;
     }
 
+    bsp_time.read = Sys_Microseconds() - time;
+
     if (filelen < sizeof(dheader_t)) {
         ret = Q_ERR_FILE_TOO_SMALL;
         goto fail2;
@@ -856,16 +897,28 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
     Hunk_Begin(&bsp->hunk, memsize);
 
     // calculate the checksum
-    bsp->checksum = Com_BlockChecksum(buf, filelen);
+    BSP_StartChecksum(&checksum, buf, filelen);
+
+    time = Sys_Microseconds();
 
     // load all lumps
     for (i = 0; i < q_countof(bsp_lumps); i++) {
         ret = bsp_lumps[i].load[extended](bsp, buf + lump_ofs[i], lump_count[i]);
         if (ret) {
-            goto fail1;
+            break;
         }
     }
 
+    bsp_time.lumps = Sys_Microseconds() - time;
+
+    // tree validation needs the checksum
+    bsp->checksum = BSP_FinishChecksum(&checksum);
+    if (ret) {
+        goto fail1;
+    }
+
+    time = Sys_Microseconds();
+
     ret = BSP_ValidateAreaPortals(bsp);
     if (ret) {
         goto fail1;
@@ -889,10 +942,11 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
 
     Hunk_End(&bsp->hunk);
 
-    List_Append(&bsp_cache, &bsp->entry);
-
     FS_FreeFile(buf);
 
+    bsp_time.validate = Sys_Microseconds() - time;
+    bsp_time.total = Sys_Microseconds() - start;
+
     *bsp_p = bsp;
     return Q_ERR_SUCCESS;
 
@@ -904,6 +958,99 @@ fail2:
     return ret;
 }
 
+/*
+==================
+BSP_Load
+
+Loads in the map and all submodels
+==================
+*/
+int BSP_Load(const char *name, bsp_t **bsp_p)
+{
+    bsp_t   *bsp;
+    int     ret;
+
+    Q_assert(name);
+    Q_assert(bsp_p);
+
+    *bsp_p = NULL;
+
+    if (!*name)
+        return Q_ERR(ENOENT);
+
+    if ((bsp = BSP_Find(name)) != NULL) {
+        Com_PageInMemory(bsp->hunk.base, bsp->hunk.cursize);
+        bsp->refcount++;
+        *bsp_p = bsp;
+        return Q_ERR_SUCCESS;
+    }
+
+    ret = BSP_LoadFile(name, &bsp);
+    if (ret) {
+        return ret;
+    }
+
+    List_Append(&bsp_cache, &bsp->entry);
+
+    *bsp_p = bsp;
+    return Q_ERR_SUCCESS;
+}
+
+/*
+==================
+BSP_Benchmark_f
+
+Loads the map bypassing the cache and prints average timings
+==================
+*/
+static void BSP_Benchmark_f(void)
+{
+    char        name[MAX_QPATH];
+    uint64_t    read, checksum, lumps, validate, total;
+    int         i, count, ret;
+    bsp_t       *bsp;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <mapname> [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp") >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    count = 1;
+    if (Cmd_Argc() > 2)
+        count = Q_clip(Q_atoi(Cmd_Argv(2)), 1, 1000);
+
+    read = checksum = lumps = validate = total = 0;
+    for (i = 0; i < count; i++) {
+        ret = BSP_LoadFile(name, &bsp);
+        if (ret) {
+            Com_EPrintf("Couldn't load %s: %s\n", name, BSP_ErrorString(ret));
+            return;
+        }
+
+        Hunk_Free(&bsp->hunk);
+        Z_Free(bsp);
+
+        read += bsp_time.read;
+        checksum += bsp_time.checksum;
+        lumps += bsp_time.lumps;
+        validate += bsp_time.validate;
+        total += bsp_time.total;
+    }
+
+    Com_Printf("%s: %d load%s, checksum on %s thread\n", name, count,
+               count == 1 ? "" : "s", bsp_time.threaded ? "worker" : "main");
+    Com_Printf("%8.3f ms : read\n", read * 1e-3 / count);
+    Com_Printf("%8.3f ms : checksum\n", checksum * 1e-3 / count);
+    Com_Printf("%8.3f ms : lumps\n", lumps * 1e-3 / count);
+    Com_Printf("%8.3f ms : validate\n", validate * 1e-3 / count);
+    Com_Printf("%8.3f ms : total\n", total * 1e-3 / count);
+}
+
 const char *BSP_ErrorString(int err)
 {
     switch (err) {
@@ -1162,6 +1309,7 @@ void BSP_Init(void)
     map_visibility_patch = Cvar_Get("map_visibility_patch", "1", 0);
 
     Cmd_AddCommand("bsplist", BSP_List_f);
+    Cmd_AddCommand("bsp_benchmark", BSP_Benchmark_f);
 
     List_Init(&bsp_cache);
 }
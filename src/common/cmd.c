@@ -80,6 +80,21 @@ void Cbuf_Init(void)
     cmd_buffer.exec = Cmd_ExecuteString;
 }
 
+/*
+============
+Cbuf_Compact
+
+Moves unexecuted text to the beginning of the buffer
+============
+*/
+static void Cbuf_Compact(cmdbuf_t *buf)
+{
+    if (buf->readcount) {
+        memmove(buf->text, buf->text + buf->readcount, buf->cursize);
+        buf->readcount = 0;
+    }
+}
+
 /*
 ============
 Cbuf_AddText
@@ -96,7 +111,10 @@ void Cbuf_AddText(cmdbuf_t *buf, const char *text)
         Com_WPrintf("%s: overflow\n", __func__);
         return;
     }
-    memcpy(buf->text + buf->cursize, text, l);
+    if (l > buf->maxsize - buf->cursize - buf->readcount) {
+        Cbuf_Compact(buf);
+    }
+    memcpy(buf->text + buf->readcount + buf->cursize, text, l);
     buf->cursize += l;
 }
 
@@ -122,9 +140,15 @@ void Cbuf_InsertText(cmdbuf_t *buf, const char *text)
         return;
     }
 
-    memmove(buf->text + l + 1, buf->text, buf->cursize);
-    memcpy(buf->text, text, l);
-    buf->text[l] = '\n';
+    // reuse space left by already executed commands if possible
+    if (buf->readcount > l) {
+        buf->readcount -= l + 1;
+    } else {
+        memmove(buf->text + l + 1, buf->text + buf->readcount, buf->cursize);
+        buf->readcount = 0;
+    }
+    memcpy(buf->text + buf->readcount, text, l);
+    buf->text[buf->readcount + l] = '\n';
     buf->cursize += l + 1;
 }
 
@@ -149,7 +173,7 @@ void Cbuf_Execute(cmdbuf_t *buf)
         }
 
 // find a \n or ; line break
-        text = buf->text;
+        text = buf->text + buf->readcount;
 
         quotes = 0;
         for (i = 0; i < buf->cursize; i++) {
@@ -169,15 +193,16 @@ void Cbuf_Execute(cmdbuf_t *buf)
             ok = true;
         }
 
-// delete the text from the command buffer and move remaining commands down
-// this is necessary because commands (exec, alias) can insert data at the
+// delete the text from the command buffer by advancing read offset
+// instead of moving remaining commands down, this keeps executing large
+// scripts linear. commands (exec, alias) can still insert data at the
 // beginning of the text buffer
         if (i == buf->cursize) {
-            buf->cursize = 0;
+            buf->cursize = buf->readcount = 0;
         } else {
             i++;
             buf->cursize -= i;
-            memmove(text, text + i, buf->cursize);
+            buf->readcount = buf->cursize ? buf->readcount + i : 0;
         }
 
 // execute the command line
@@ -210,7 +235,8 @@ Cbuf_Clear
 */
 void Cbuf_Clear(cmdbuf_t *buf)
 {
-    buf->cursize = buf->waitCount = buf->aliasCount = 0;
+    buf->cursize = buf->readcount = 0;
+    buf->waitCount = buf->aliasCount = 0;
 }
 
 /*
@@ -221,6 +247,31 @@ void Cbuf_Clear(cmdbuf_t *buf)
 ==============================================================================
 */
 
+/*
+============
+Cmd_NeedsExpansion
+
+Returns false if Cmd_MacroExpandString would return text unmodified.
+Lets aliases and triggers decide this once when defined instead of
+rescanning their bodies each time they run.
+============
+*/
+static bool Cmd_NeedsExpansion(const char *text)
+{
+    const char *s;
+    int quotes = 0;
+
+    for (s = text; *s; s++) {
+        if (*s == '$')
+            return true;
+        if (*s == '"')
+            quotes++;
+    }
+
+    // let expansion print the error
+    return (quotes & 1) || s - text >= MAX_STRING_CHARS;
+}
+
 #define ALIAS_HASH_SIZE    64
 
 #define FOR_EACH_ALIAS_HASH(alias, hash) \
@@ -232,6 +283,7 @@ typedef struct {
     list_t  hashEntry;
     list_t  listEntry;
     char    *value;
+    bool    expand;
     char    name[1];
 } cmdalias_t;
 
@@ -281,6 +333,7 @@ void Cmd_AliasSet(const char *name, const char *cmd)
     if (a) {
         Z_Free(a->value);
         a->value = Cmd_CopyString(cmd);
+        a->expand = Cmd_NeedsExpansion(cmd);
         return;
     }
 
@@ -288,6 +341,7 @@ void Cmd_AliasSet(const char *name, const char *cmd)
     a = Cmd_Malloc(sizeof(*a) + len);
     memcpy(a->name, name, len + 1);
     a->value = Cmd_CopyString(cmd);
+    a->expand = Cmd_NeedsExpansion(cmd);
 
     List_Append(&cmd_alias, &a->listEntry);
 
@@ -452,6 +506,7 @@ typedef struct {
     list_t  entry;
     char    *match;
     char    *command;
+    bool    expand;
 } cmd_trigger_t;
 
 static list_t    cmd_triggers;
@@ -525,6 +580,7 @@ static void Cmd_Trigger_f(void)
     trigger->match = trigger->command + cmdlen;
     memcpy(trigger->command, command, cmdlen);
     memcpy(trigger->match, match, matchlen);
+    trigger->expand = Cmd_NeedsExpansion(match);
     List_Append(&cmd_triggers, &trigger->entry);
 }
 
@@ -586,7 +642,10 @@ void Cmd_ExecTrigger(const char *string)
 
     // execute matching triggers
     FOR_EACH_TRIGGER(trigger) {
-        match = Cmd_MacroExpandString(trigger->match, false);
+        if (trigger->expand)
+            match = Cmd_MacroExpandString(trigger->match, false);
+        else
+            match = trigger->match;
         if (match && Com_WildCmp(match, string)) {
             Cbuf_AddText(&cmd_buffer, trigger->command);
             Cbuf_AddText(&cmd_buffer, "\n");
@@ -1578,7 +1637,10 @@ void Cmd_ExecuteCommand(cmdbuf_t *buf)
             Com_WPrintf("Runaway alias loop\n");
             return;
         }
-        text = Cmd_MacroExpandString(a->value, true);
+        if (a->expand)
+            text = Cmd_MacroExpandString(a->value, true);
+        else
+            text = a->value;
         if (text) {
             buf->aliasCount++;
             Cbuf_InsertText(buf, text);
@@ -88,6 +88,7 @@ cvar_t  *com_version;
 
 cvar_t  *logfile_enable;    // 1 = create new, 2 = append to existing
 cvar_t  *logfile_flush;     // 1 = flush after each print
+cvar_t  *logfile_async;     // 1 = write from background thread, 2 = also drop if full
 cvar_t  *logfile_name;
 cvar_t  *logfile_prefix;
 #if USE_SYSCON
@@ -243,6 +244,12 @@ static void logfile_open(void)
             mode |= FS_BUF_LINE;
         }
     }
+    if (logfile_async->integer > 0) {
+        mode |= FS_FLAG_ASYNC;
+        if (logfile_async->integer > 1) {
+            mode |= FS_FLAG_DROP;
+        }
+    }
 
     f = FS_EasyOpenFile(buffer, sizeof(buffer), mode | FS_FLAG_TEXT,
                         "logs/", logfile_name->string, ".log");
@@ -710,6 +717,38 @@ static size_t Com_MapList_m(char *buffer, size_t size)
     return total;
 }
 
+static struct {
+    uint64_t    start;
+    uint64_t    awake;      // time spent running frames
+    uint64_t    asleep;     // time spent waiting for next frame
+    uint64_t    late_total; // wakeup delay past frame deadline
+    uint64_t    late_max;
+    unsigned    frames;
+    unsigned    deadlines;  // number of sleeps that ran until deadline
+} com_frameStats;
+
+static void Com_FrameStats_f(void)
+{
+    uint64_t total = com_frameStats.awake + com_frameStats.asleep;
+
+    if (!com_frameStats.frames || !total) {
+        Com_Printf("No frames run since last query.\n");
+        return;
+    }
+
+    Com_Printf("%u frames in %.1f sec, %.1f%% time awake\n",
+               com_frameStats.frames, total * 1e-6,
+               com_frameStats.awake * 100.0 / total);
+
+    if (com_frameStats.deadlines) {
+        Com_Printf("Wakeup past deadline: %"PRIu64" usec avg, %"PRIu64" usec max\n",
+                   com_frameStats.late_total / com_frameStats.deadlines,
+                   com_frameStats.late_max);
+    }
+
+    memset(&com_frameStats, 0, sizeof(com_frameStats));
+}
+
 static void Com_LastError_f(void)
 {
     Com_Printf("%s\n", com_errorMsg);
@@ -911,6 +950,7 @@ void Qcommon_Init(int argc, char **argv)
     fixedtime = Cvar_Get("fixedtime", "0", CVAR_CHEAT);
     logfile_enable = Cvar_Get("logfile", "0", 0);
     logfile_flush = Cvar_Get("logfile_flush", "0", 0);
+    logfile_async = Cvar_Get("logfile_async", "0", 0);
     logfile_name = Cvar_Get("logfile_name", "console", 0);
     logfile_prefix = Cvar_Get("logfile_prefix", "[%Y-%m-%d %H:%M] ", 0);
 #if USE_SYSCON
@@ -993,6 +1033,7 @@ void Qcommon_Init(int argc, char **argv)
     // after FS is initialized, open logfile
     logfile_enable->changed = logfile_enable_changed;
     logfile_flush->changed = logfile_param_changed;
+    logfile_async->changed = logfile_param_changed;
     logfile_name->changed = logfile_param_changed;
     logfile_enable_changed(logfile_enable);
 
@@ -1001,6 +1042,7 @@ void Qcommon_Init(int argc, char **argv)
     Com_AddEarlyCommands(true);
 
     Cmd_AddCommand("lasterror", Com_LastError_f);
+    Cmd_AddCommand("framestats", Com_FrameStats_f);
 
     Cmd_AddCommand("quit", Com_Quit_f);
 #if USE_SERVER
@@ -1066,6 +1108,9 @@ void Qcommon_Frame(void)
     unsigned oldtime, msec;
     static unsigned remaining;
     static float frac;
+    static uint64_t deadline, waketime;
+    uint64_t sleeptime, now;
+    int ret;
 
     if (setjmp(com_abortframe)) {
         return; // an ERR_DROP was thrown
@@ -1080,24 +1125,41 @@ void Qcommon_Frame(void)
         time_before = Sys_Milliseconds();
 #endif
 
-    // sleep on network sockets when running a dedicated server
-    // still do a select(), but don't sleep when running a client!
-    NET_Sleep(remaining);
+    // sleep on network sockets until the next frame is due. deadline is
+    // absolute to avoid accumulating rounding error of millisecond sleeps.
+    sleeptime = Sys_Microseconds();
+    ret = NET_SleepUntil(deadline);
 
     // calculate time spent running last frame and sleeping
+    now = Sys_Microseconds();
     oldtime = com_eventTime;
-    com_eventTime = Sys_Milliseconds();
+    com_eventTime = now / 1000;
     if (oldtime > com_eventTime) {
         oldtime = com_eventTime;
     }
     msec = com_eventTime - oldtime;
 
+    if (waketime) {
+        com_frameStats.awake += sleeptime - waketime;
+        com_frameStats.asleep += now - sleeptime;
+        com_frameStats.frames++;
+        if (!ret && deadline > sleeptime) {
+            uint64_t late = now > deadline ? now - deadline : 0;
+            com_frameStats.late_total += late;
+            com_frameStats.late_max = max(com_frameStats.late_max, late);
+            com_frameStats.deadlines++;
+        }
+    }
+
 #if USE_CLIENT
-    // spin until msec is non-zero if running a client
+    // wait until msec is non-zero if running a client
     if (!dedicated->integer && !com_timedemo->integer) {
         while (msec < 1) {
             bool break_now = CL_ProcessEvents();
-            com_eventTime = Sys_Milliseconds();
+            if (!break_now)
+                NET_SleepUntil((now / 1000 + 1) * 1000);
+            now = Sys_Microseconds();
+            com_eventTime = now / 1000;
             msec = com_eventTime - oldtime;
             if (break_now)
                 break;
@@ -1105,6 +1167,8 @@ void Qcommon_Frame(void)
     }
 #endif
 
+    waketime = now;
+
     if (msec > 250) {
         Com_DPrintf("Hitch warning: %u msec frame time\n", msec);
         msec = 100; // time was unreasonable
@@ -1164,4 +1228,7 @@ void Qcommon_Frame(void)
                    all, ev, sv, gm, cl, rf);
     }
 #endif
+
+    // next frame is due when millisecond clock reaches com_eventTime + remaining
+    deadline = now - now % 1000 + remaining * 1000ULL;
 }
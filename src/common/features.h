@@ -37,6 +37,9 @@ static const char *Com_GetFeatures(void)
 #if USE_DEBUG
     "debug "
 #endif
+#if USE_EPOLL
+    "epoll "
+#endif
 #if USE_GAME_ABI_HACK
     "game-abi-hack "
 #endif
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/prompt.h"
 #include "common/intreadwrite.h"
 #include "system/system.h"
+#include "system/pthread.h"
 #include "client/client.h"
 #include "server/server.h"
 #include "format/pak.h"
@@ -51,6 +52,8 @@ QUAKE FILESYSTEM
 
 #define MAX_FILE_HANDLES    1024
 
+#define ASYNC_BUFSIZE       (1 << 18)   // queue up to 256k for async writes
+
 #if USE_ZLIB
 #define ZIP_BUFSIZE     (1 << 16)   // inflate in blocks of 64k
 #define ZIP_MAXFILES    (1 << 20)   // 1 million files
@@ -152,11 +155,26 @@ typedef struct {
 #endif
     packfile_t  *entry;     // pack entry this handle is tied to
     pack_t      *pack;      // points to the pack entry is from
+    struct asyncfile_s *async;  // background writer state for FS_FLAG_ASYNC
     int         error;      // stream error indicator from read/write operation
     int64_t     position;   // reading position for FS_PAK/FS_ZIP
     int64_t     length;     // total cached file length
 } file_t;
 
+// Data written to FS_FLAG_ASYNC files is queued into ring buffer and written
+// out by a separate thread. Head and tail only grow, offsets are taken modulo
+// buffer size.
+typedef struct asyncfile_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  queued;     // signaled when data is queued or terminating
+    pthread_cond_t  written;    // signaled when queued data is written out
+    pthread_t       thread;
+    bool            terminate;
+    int             error;      // first error from writer thread
+    size_t          head, tail;
+    byte            data[ASYNC_BUFSIZE];
+} asyncfile_t;
+
 typedef struct {
     list_t      entry;
     unsigned    targlen;
@@ -185,18 +203,63 @@ static unsigned     fs_count_read;
 static unsigned     fs_count_open;
 static unsigned     fs_count_strcmp;
 static unsigned     fs_count_strlwr;
+static unsigned     fs_count_lookup;
+static unsigned     fs_count_negative;
+static unsigned     fs_count_rescan;
 #define FS_COUNT_READ       fs_count_read++
 #define FS_COUNT_OPEN       fs_count_open++
 #define FS_COUNT_STRCMP     fs_count_strcmp++
 #define FS_COUNT_STRLWR     fs_count_strlwr++
+static unsigned     fs_count_async_write;
+static unsigned     fs_count_async_stall;
+static unsigned     fs_count_async_drop;
+#define FS_COUNT_LOOKUP     fs_count_lookup++
+#define FS_COUNT_NEGATIVE   fs_count_negative++
+#define FS_COUNT_RESCAN     fs_count_rescan++
+#define FS_COUNT_ASYNC_WRITE    fs_count_async_write++
+#define FS_COUNT_ASYNC_STALL    fs_count_async_stall++
+#define FS_COUNT_ASYNC_DROP     fs_count_async_drop++
 #else
 #define FS_COUNT_READ       (void)0
 #define FS_COUNT_OPEN       (void)0
 #define FS_COUNT_STRCMP     (void)0
 #define FS_COUNT_STRLWR     (void)0
+#define FS_COUNT_LOOKUP     (void)0
+#define FS_COUNT_NEGATIVE   (void)0
+#define FS_COUNT_RESCAN     (void)0
+#define FS_COUNT_ASYNC_WRITE    (void)0
+#define FS_COUNT_ASYNC_STALL    (void)0
+#define FS_COUNT_ASYNC_DROP     (void)0
 #endif
 
+// Cached listings of loose directories, keyed by search path and directory
+// name. Lets open_file_read() reject missing files without a syscall.
+// Number of entries is capped since remote clients can make the server probe
+// arbitrary (nonexistent) directories via downloads.
+#define DIRCACHE_HASH_SIZE  1024
+#define DIRCACHE_MAX_DIRS   2048
+
+typedef struct dircache_s {
+    struct dircache_s *hash_next;
+    list_t          lru_entry;  // most recently used first
+    searchpath_t    *search;
+    unsigned        checked;    // time of last mtime check
+    unsigned        generation; // fs_dircache_generation at last check
+    int64_t         mtime;      // -1 if directory doesn't exist
+    bool            stable;     // false if modified during listing second
+    int             num_files;
+    char            **files;    // sorted case insensitively
+    size_t          namelen;
+    char            name[1];    // with trailing slash, empty for root
+} dircache_t;
+
+static dircache_t   *fs_dircache[DIRCACHE_HASH_SIZE];
+static LIST_DECL(fs_dircache_lru);
+static int          fs_dircache_count;
+static unsigned     fs_dircache_generation;
+
 static cvar_t       *fs_autoexec;
+static cvar_t       *fs_lookup_cache;
 
 #if USE_DEBUG
 static cvar_t       *fs_debug;
@@ -450,6 +513,165 @@ static symlink_t *expand_links(const list_t *list, char *buffer, size_t *len_p)
     return NULL;
 }
 
+static int write_file_data(file_t *file, const void *buf, size_t len)
+{
+    switch (file->type) {
+    case FS_REAL:
+        if (fwrite(buf, 1, len, file->fp) != len)
+            return Q_ERR_FAILURE;
+        break;
+#if USE_ZLIB
+    case FS_GZ:
+        if (gzwrite(file->zfp, buf, len) != len)
+            return Q_ERR_LIBRARY_ERROR;
+        break;
+#endif
+    default:
+        Q_assert(!"bad file type");
+    }
+
+    return Q_ERR_SUCCESS;
+}
+
+static void *async_write_func(void *arg)
+{
+    file_t *file = arg;
+    asyncfile_t *async = file->async;
+    size_t ofs, len;
+    int ret;
+
+    pthread_mutex_lock(&async->lock);
+    while (1) {
+        while (async->head == async->tail && !async->terminate)
+            pthread_cond_wait(&async->queued, &async->lock);
+
+        if (async->head == async->tail)
+            break;
+
+        // write out everything queued so far in one go
+        ofs = async->tail & (ASYNC_BUFSIZE - 1);
+        len = min(async->head - async->tail, ASYNC_BUFSIZE - ofs);
+
+        pthread_mutex_unlock(&async->lock);
+        ret = async->error ? async->error : write_file_data(file, async->data + ofs, len);
+        pthread_mutex_lock(&async->lock);
+
+        async->tail += len;
+        async->error = ret;
+        pthread_cond_signal(&async->written);
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return NULL;
+}
+
+static void open_async(file_t *file)
+{
+    asyncfile_t *async = FS_Mallocz(sizeof(*async));
+
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->queued, NULL);
+    pthread_cond_init(&async->written, NULL);
+    file->async = async;
+
+    // fall back to synchronous writes
+    if (pthread_create(&async->thread, NULL, async_write_func, file)) {
+        Com_WPrintf("Couldn't create async write thread\n");
+        pthread_mutex_destroy(&async->lock);
+        pthread_cond_destroy(&async->queued);
+        pthread_cond_destroy(&async->written);
+        Z_Free(async);
+        file->async = NULL;
+    }
+}
+
+static int close_async(file_t *file)
+{
+    asyncfile_t *async = file->async;
+    int ret;
+
+    pthread_mutex_lock(&async->lock);
+    async->terminate = true;
+    pthread_mutex_unlock(&async->lock);
+
+    pthread_cond_signal(&async->queued);
+    Q_assert(!pthread_join(async->thread, NULL));
+
+    ret = async->error;
+
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->queued);
+    pthread_cond_destroy(&async->written);
+    Z_Free(async);
+    file->async = NULL;
+
+    return ret;
+}
+
+// waits for all queued data to be written out
+static int drain_async(file_t *file)
+{
+    asyncfile_t *async = file->async;
+    int ret;
+
+    pthread_mutex_lock(&async->lock);
+    while (async->head != async->tail)
+        pthread_cond_wait(&async->written, &async->lock);
+    ret = async->error;
+    pthread_mutex_unlock(&async->lock);
+
+    return ret;
+}
+
+static int write_async(file_t *file, const void *buf, size_t len)
+{
+    asyncfile_t *async = file->async;
+    const byte *data = buf;
+    size_t ofs, n;
+    int ret = len;
+
+    pthread_mutex_lock(&async->lock);
+
+    if (async->error) {
+        ret = async->error;
+        goto done;
+    }
+
+    // drop the entire write if it doesn't fit
+    if (file->mode & FS_FLAG_DROP && len > ASYNC_BUFSIZE - (async->head - async->tail)) {
+        FS_COUNT_ASYNC_DROP;
+        goto done;
+    }
+
+    FS_COUNT_ASYNC_WRITE;
+
+    while (len) {
+        if (async->head - async->tail == ASYNC_BUFSIZE) {
+            FS_COUNT_ASYNC_STALL;
+            pthread_cond_wait(&async->written, &async->lock);
+            if (async->error) {
+                ret = async->error;
+                goto done;
+            }
+            continue;
+        }
+
+        ofs = async->head & (ASYNC_BUFSIZE - 1);
+        n = min(len, ASYNC_BUFSIZE - (async->head - async->tail));
+        n = min(n, ASYNC_BUFSIZE - ofs);
+        memcpy(async->data + ofs, data, n);
+        async->head += n;
+        data += n;
+        len -= n;
+
+        pthread_cond_signal(&async->queued);
+    }
+
+done:
+    pthread_mutex_unlock(&async->lock);
+    return ret;
+}
+
 /*
 ================
 FS_Length
@@ -481,6 +703,9 @@ int64_t FS_Tell(qhandle_t f)
     if (!file)
         return Q_ERR(EBADF);
 
+    if (file->async && (ret = drain_async(file)))
+        return ret;
+
     switch (file->type) {
     case FS_REAL:
         ret = os_ftell(file->fp);
@@ -552,10 +777,14 @@ Seeks to an absolute position within the file.
 int FS_Seek(qhandle_t f, int64_t offset, int whence)
 {
     file_t *file = file_for_handle(f);
+    int ret;
 
     if (!file)
         return Q_ERR(EBADF);
 
+    if (file->async && (ret = drain_async(file)))
+        return ret;
+
     switch (file->type) {
     case FS_REAL:
         if (os_fseek(file->fp, offset, whence)) {
@@ -611,6 +840,9 @@ int FS_CreatePath(char *path)
     }
 #endif
 
+    // new files are expected to show up soon
+    FS_InvalidateCache();
+
     // skip leading slash(es)
     for (; *ofs == '/'; ofs++)
         ;
@@ -646,6 +878,12 @@ int FS_CloseFile(qhandle_t f)
         return Q_ERR(EBADF);
 
     ret = file->error;
+    if (file->async) {
+        int err = close_async(file);
+        if (!ret)
+            ret = err;
+    }
+
     switch (file->type) {
     case FS_REAL:
         if (fclose(file->fp))
@@ -909,6 +1147,9 @@ static int64_t open_file_write(file_t *file, const char *name)
         goto fail;
     }
 
+    if (file->mode & FS_FLAG_ASYNC)
+        open_async(file);
+
     FS_DPrintf("%s: %s: %"PRId64" bytes\n", __func__, fullpath, pos);
     return pos;
 
@@ -1256,6 +1497,215 @@ static int check_for_gzip(file_t *file, const char *fullpath)
 }
 #endif
 
+static int dircache_cmp(const void *p1, const void *p2)
+{
+    return Q_strcasecmp(*(const char **)p1, *(const char **)p2);
+}
+
+static void dircache_free_files(dircache_t *dir)
+{
+    int i;
+
+    for (i = 0; i < dir->num_files; i++)
+        Z_Free(dir->files[i]);
+    Z_Free(dir->files);
+
+    dir->files = NULL;
+    dir->num_files = 0;
+}
+
+static void dircache_flush(void)
+{
+    dircache_t *dir, *next;
+    int i;
+
+    for (i = 0; i < DIRCACHE_HASH_SIZE; i++) {
+        for (dir = fs_dircache[i]; dir; dir = next) {
+            next = dir->hash_next;
+            dircache_free_files(dir);
+            Z_Free(dir);
+        }
+        fs_dircache[i] = NULL;
+    }
+
+    List_Init(&fs_dircache_lru);
+    fs_dircache_count = 0;
+}
+
+// Frees least recently used directory listing.
+static void dircache_evict(void)
+{
+    dircache_t *dir = LIST_LAST(dircache_t, &fs_dircache_lru, lru_entry);
+    unsigned hash = FS_HashPathLen(dir->name, dir->namelen, DIRCACHE_HASH_SIZE);
+    dircache_t **back;
+
+    for (back = &fs_dircache[hash]; *back != dir; back = &(*back)->hash_next)
+        ;
+    *back = dir->hash_next;
+
+    List_Remove(&dir->lru_entry);
+    dircache_free_files(dir);
+    Z_Free(dir);
+    fs_dircache_count--;
+}
+
+// Stats the directory and re-reads its listing if it has been modified.
+static void dircache_check(dircache_t *dir, unsigned now)
+{
+    char fullpath[MAX_OSPATH];
+    listfiles_t list = { 0 };
+    Q_STATBUF st;
+    int64_t mtime;
+    size_t len;
+
+    dir->checked = now;
+    dir->generation = fs_dircache_generation;
+
+    len = Q_concat(fullpath, sizeof(fullpath), dir->search->filename, "/", dir->name);
+    if (len >= sizeof(fullpath)) {
+        dir->mtime = -1;
+        dir->stable = false;
+        return;
+    }
+    fullpath[len - 1] = 0;  // strip trailing slash
+
+    if (os_stat(fullpath, &st) == 0 && Q_ISDIR(st.st_mode))
+        mtime = st.st_mtime;
+    else
+        mtime = -1;
+
+    if (mtime == dir->mtime && dir->stable)
+        return;
+
+    FS_COUNT_RESCAN;
+
+    dircache_free_files(dir);
+
+    dir->mtime = mtime;
+    dir->stable = true;
+    if (mtime == -1)
+        return;
+
+    // files created within the same second may not change the mtime
+    dir->stable = mtime < time(NULL) - 1;
+
+    list.baselen = len;
+    Sys_ListFiles_r(&list, fullpath, 0);
+
+    if (list.count)
+        qsort(list.files, list.count, sizeof(list.files[0]), dircache_cmp);
+
+    dir->files = (char **)list.files;
+    dir->num_files = list.count;
+}
+
+// Returns up to date listing of the directory. Directory name is expected to
+// include trailing slash, unless empty.
+static dircache_t *dircache_get(searchpath_t *search, const char *path, size_t dirlen)
+{
+    unsigned hash = FS_HashPathLen(path, dirlen, DIRCACHE_HASH_SIZE);
+    unsigned now = Sys_Milliseconds();
+    dircache_t *dir;
+
+    for (dir = fs_dircache[hash]; dir; dir = dir->hash_next) {
+        if (dir->search != search || dir->namelen != dirlen || memcmp(dir->name, path, dirlen))
+            continue;
+
+        // revalidate periodically and after files were written
+        if (dir->generation != fs_dircache_generation ||
+            now - dir->checked >= (unsigned)fs_lookup_cache->integer)
+            dircache_check(dir, now);
+
+        List_Remove(&dir->lru_entry);
+        List_Insert(&fs_dircache_lru, &dir->lru_entry);
+        return dir;
+    }
+
+    if (fs_dircache_count >= DIRCACHE_MAX_DIRS)
+        dircache_evict();
+
+    dir = FS_Mallocz(sizeof(*dir) + dirlen);
+    dir->search = search;
+    dir->mtime = -1;
+    dir->namelen = dirlen;
+    memcpy(dir->name, path, dirlen);
+    dir->name[dirlen] = 0;
+    dir->hash_next = fs_dircache[hash];
+    fs_dircache[hash] = dir;
+    List_Insert(&fs_dircache_lru, &dir->lru_entry);
+    fs_dircache_count++;
+
+    dircache_check(dir, now);
+    return dir;
+}
+
+// Returns false if file is known not to exist in the directory tree of this
+// search path. Expects normalized, validated path.
+static bool dircache_lookup(searchpath_t *search, const char *path)
+{
+    const char *name = COM_SkipPath(path);
+    dircache_t *dir;
+
+    // dotfiles are not listed
+    if (*name == '.')
+        return true;
+
+    dir = dircache_get(search, path, name - path);
+
+    if (dir->mtime == -1)
+        return false;
+
+    // unreadable directory, can't tell
+    if (!dir->files)
+        return true;
+
+    return bsearch(&name, dir->files, dir->num_files,
+                   sizeof(dir->files[0]), dircache_cmp);
+}
+
+static bool dircache_may_exist(searchpath_t *search, const char *path, path_valid_t valid)
+{
+    if (fs_lookup_cache->integer <= 0)
+        return true;
+
+    FS_COUNT_LOOKUP;
+
+    if (dircache_lookup(search, path))
+        return true;
+
+#ifndef _WIN32
+    if (valid == PATH_MIXED_CASE) {
+        char buffer[MAX_OSPATH];
+
+        Q_strlcpy(buffer, path, sizeof(buffer));
+        Q_strlwr(buffer);
+        if (dircache_lookup(search, buffer))
+            return true;
+    }
+#endif
+
+    FS_COUNT_NEGATIVE;
+    return false;
+}
+
+/*
+================
+FS_InvalidateCache
+
+Forces cached directory listings to be revalidated on next lookup. Should be
+called after creating files in game directory bypassing the FS_* functions.
+================
+*/
+void FS_InvalidateCache(void)
+{
+    fs_dircache_generation++;
+}
+
+static void fs_lookup_cache_changed(cvar_t *self)
+{
+    dircache_flush();
+}
+
 static int64_t open_from_disk(file_t *file, const char *fullpath)
 {
     FILE *fp;
@@ -1373,6 +1823,10 @@ static int64_t open_file_read(file_t *file, const char *normalized, size_t namel
             if (valid == PATH_INVALID) {
                 continue;
             }
+            // skip the disk if cached listing doesn't have it
+            if (!dircache_may_exist(search, normalized, valid)) {
+                continue;
+            }
             // check a file in the directory tree
             if (Q_concat(fullpath, sizeof(fullpath), search->filename,
                          "/", normalized) >= sizeof(fullpath)) {
@@ -1571,6 +2025,9 @@ int FS_Flush(qhandle_t f)
     if ((file->mode & FS_MODE_MASK) == FS_MODE_READ)
         return Q_ERR(EBADF);
 
+    if (file->async && (ret = drain_async(file)))
+        return ret;
+
     switch (file->type) {
     case FS_REAL:
         if (fflush(file->fp))
@@ -1597,6 +2054,7 @@ FS_Write
 int FS_Write(const void *buf, size_t len, qhandle_t f)
 {
     file_t  *file = file_for_handle(f);
+    int     ret;
 
     if (!file)
         return Q_ERR(EBADF);
@@ -1614,23 +2072,14 @@ int FS_Write(const void *buf, size_t len, qhandle_t f)
     if (len == 0)
         return 0;
 
-    switch (file->type) {
-    case FS_REAL:
-        if (fwrite(buf, 1, len, file->fp) != len) {
-            file->error = Q_ERR_FAILURE;
-            return file->error;
-        }
-        break;
-#if USE_ZLIB
-    case FS_GZ:
-        if (gzwrite(file->zfp, buf, len) != len) {
-            file->error = Q_ERR_LIBRARY_ERROR;
-            return file->error;
-        }
-        break;
-#endif
-    default:
-        Q_assert(!"bad file type");
+    if (file->async)
+        ret = write_async(file, buf, len);
+    else
+        ret = write_file_data(file, buf, len);
+
+    if (ret < 0) {
+        file->error = ret;
+        return ret;
     }
 
     return len;
@@ -1995,6 +2444,8 @@ int FS_RenameFile(const char *from, const char *to)
     if (rename(frompath, topath))
         return Q_ERRNO;
 
+    FS_InvalidateCache();
+
     return Q_ERR_SUCCESS;
 }
 
@@ -2073,12 +2524,52 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     return pack;
 }
 
-// allocates hash table and inserts all filenames into it
+// names of the pack being sorted, qsort() has no context argument
+static const char *pack_sort_names;
+
+static int packfilecmp(const void *p1, const void *p2)
+{
+    const packfile_t *f1 = p1;
+    const packfile_t *f2 = p2;
+    int ret = strcmp(pack_sort_names + f1->nameofs, pack_sort_names + f2->nameofs);
+
+    // keep original order of duplicates
+    if (!ret)
+        ret = f1->nameofs < f2->nameofs ? -1 : 1;
+
+    return ret;
+}
+
+// returns index of the first file whose name is not less than prefix
+static unsigned pack_lower_bound(const pack_t *pack, const char *prefix, size_t len)
+{
+    unsigned lo = 0, hi = pack->num_files;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (strncmp(pack->names + pack->files[mid].nameofs, prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// sorts files by name for listing and inserts them into hash table
 static void pack_calc_hashes(pack_t *pack)
 {
     packfile_t *file;
     int i;
 
+    // force conversion to lower case. mixed case paths are annoying.
+    for (i = 0, file = pack->files; i < pack->num_files; i++, file++)
+        Q_strlwr(pack->names + file->nameofs);
+
+    pack_sort_names = pack->names;
+    qsort(pack->files, pack->num_files, sizeof(pack->files[0]), packfilecmp);
+    pack_sort_names = NULL;
+
     pack->hash_size = Q_npot32(pack->num_files / 3);
     pack->file_hash = FS_Mallocz(pack->hash_size * sizeof(pack->file_hash[0]));
 
@@ -2086,9 +2577,6 @@ static void pack_calc_hashes(pack_t *pack)
         char *name = pack->names + file->nameofs;
         unsigned hash;
 
-        // force conversion to lower case. mixed case paths are annoying.
-        Q_strlwr(name);
-
         hash = Com_HashString(name, pack->hash_size);
         file->hash_next = pack->file_hash[hash];
         pack->file_hash[hash] = file;
@@ -2746,12 +3234,60 @@ static int alphacmp(const void *p1, const void *p2)
     return FS_pathcmp(s1, s2);
 }
 
-/*
-=================
-FS_ListFiles
-=================
-*/
-void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *count_p)
+// Lists regular files in a single directory using cached listing. Equivalent
+// to non-recursive Sys_ListFiles_r() call.
+static void list_cached_dir(listfiles_t *list, searchpath_t *search,
+                            const char *path, size_t pathlen)
+{
+    char buffer[MAX_OSPATH];
+    dircache_t *dir;
+    char *name;
+    int i;
+
+    if (Q_concat(buffer, sizeof(buffer), path, pathlen ? "/" : "") >= sizeof(buffer)) {
+        return;
+    }
+
+    dir = dircache_get(search, buffer, pathlen + !!pathlen);
+
+    for (i = 0; i < dir->num_files; i++) {
+        name = dir->files[i];
+
+        // check filter
+        if (list->filter && !FS_ExtCmp(list->filter, name)) {
+            continue;
+        }
+
+        // copy name off
+        if (list->flags & FS_SEARCH_SAVEPATH && pathlen) {
+            if (Q_concat(buffer, sizeof(buffer), path, "/", name) >= sizeof(buffer)) {
+                continue;
+            }
+        } else {
+            Q_strlcpy(buffer, name, sizeof(buffer));
+        }
+
+        // strip extension
+        if (list->flags & FS_SEARCH_STRIPEXT) {
+            *COM_FileExtension(buffer) = 0;
+
+            if (!*buffer) {
+                continue;
+            }
+        }
+
+        list->files = FS_ReallocList(list->files, list->count + 1);
+        list->files[list->count++] = FS_CopyString(buffer);
+
+        if (list->count >= MAX_LISTED_FILES) {
+            break;
+        }
+    }
+}
+
+// If partial is given, pack entries not starting with it are not listed.
+static void **list_files(const char *path, const char *filter, unsigned flags,
+                         const char *partial, int *count_p)
 {
     searchpath_t    *search;
     pack_t          *pack;
@@ -2759,7 +3295,8 @@ void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *c
     void            *info;
     int             i, j;
     char            normalized[MAX_OSPATH], buffer[MAX_OSPATH];
-    size_t          len, pathlen;
+    char            prefix[MAX_OSPATH];
+    size_t          len, pathlen, prefixlen;
     char            *s, *p;
 
     if (count_p) {
@@ -2791,6 +3328,17 @@ void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *c
     listfiles_t list = { .filter = filter, .flags = flags };
     path_valid_t valid = PATH_NOT_CHECKED;
 
+    // pack file names are sorted and in lower case, which allows listing
+    // them by scanning the range of names starting with this prefix
+    if (!partial || (flags & FS_SEARCH_SAVEPATH)) {
+        partial = "";
+    }
+    prefixlen = Q_concat(prefix, sizeof(prefix), path, pathlen ? "/" : "", partial);
+    if (prefixlen >= sizeof(prefix)) {
+        prefixlen = Q_concat(prefix, sizeof(prefix), path, pathlen ? "/" : "");
+    }
+    Q_strlwr(prefix);
+
     flags = default_lookup_flags(flags);
 
     for (search = fs_searchpaths; search; search = search->next) {
@@ -2804,24 +3352,16 @@ void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *c
             }
 
             pack = search->pack;
-            for (i = 0; i < pack->num_files; i++) {
+            for (i = pack_lower_bound(pack, prefix, prefixlen); i < pack->num_files; i++) {
                 file = &pack->files[i];
                 s = pack->names + file->nameofs;
 
                 // check path
-                if (pathlen) {
-                    if (file->namelen < pathlen) {
-                        continue;
-                    }
-                    if (FS_pathcmpn(s, path, pathlen)) {
-                        continue;
-                    }
-                    if (s[pathlen] != '/') {
-                        continue;   // matched prefix must be a directory
-                    }
-                    if (!(flags & FS_SEARCH_SAVEPATH)) {
-                        s += pathlen + 1;   // skip path
-                    }
+                if (strncmp(s, prefix, prefixlen)) {
+                    break;  // end of matching range
+                }
+                if (pathlen && !(flags & FS_SEARCH_SAVEPATH)) {
+                    s += pathlen + 1;   // skip path
                 }
 
                 // check for subdirectory
@@ -2912,19 +3452,28 @@ void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *c
                 if (valid == PATH_INVALID) {
                     continue;
                 }
-                if (Q_concat(buffer, sizeof(buffer), search->filename, "/", path) >= sizeof(buffer)) {
-                    continue;
-                }
-                if (!(flags & FS_SEARCH_SAVEPATH)) {
-                    len += pathlen + 1; // skip path
-                }
-                s = buffer;
-            } else {
-                s = search->filename;
             }
 
-            list.baselen = len;
-            Sys_ListFiles_r(&list, s, 0);
+            // plain directory listing can be served from cache
+            if (fs_lookup_cache->integer > 0 && !(list.flags & (FS_SEARCH_BYFILTER |
+                FS_SEARCH_RECURSIVE | FS_SEARCH_DIRSONLY | FS_SEARCH_EXTRAINFO))) {
+                list_cached_dir(&list, search, path, pathlen);
+            } else {
+                if (pathlen) {
+                    if (Q_concat(buffer, sizeof(buffer), search->filename, "/", path) >= sizeof(buffer)) {
+                        continue;
+                    }
+                    if (!(flags & FS_SEARCH_SAVEPATH)) {
+                        len += pathlen + 1; // skip path
+                    }
+                    s = buffer;
+                } else {
+                    s = search->filename;
+                }
+
+                list.baselen = len;
+                Sys_ListFiles_r(&list, s, 0);
+            }
         }
 
         if (list.count >= MAX_LISTED_FILES) {
@@ -2941,6 +3490,16 @@ void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *c
     return list.files;
 }
 
+/*
+=================
+FS_ListFiles
+=================
+*/
+void **FS_ListFiles(const char *path, const char *filter, unsigned flags, int *count_p)
+{
+    return list_files(path, filter, flags, NULL, count_p);
+}
+
 void **FS_FinalizeList(listfiles_t *list)
 {
     int total;
@@ -3003,7 +3562,7 @@ void FS_File_g(const char *path, const char *ext, unsigned flags, genctx_t *ctx)
     void **list;
     char *s;
 
-    list = FS_ListFiles(path, ext, flags, &numFiles);
+    list = list_files(path, ext, flags, ctx->partial, &numFiles);
     if (!list) {
         return;
     }
@@ -3325,6 +3884,12 @@ static void FS_Stats_f(void)
     Com_Printf("Total path comparisons: %u\n", fs_count_strcmp);
     Com_Printf("Total calls to open_from_disk: %u\n", fs_count_open);
     Com_Printf("Total mixed-case reopens: %u\n", fs_count_strlwr);
+    Com_Printf("Total directory cache lookups: %u, %u negative (%.1f%% hit rate)\n",
+               fs_count_lookup, fs_count_negative,
+               fs_count_lookup ? fs_count_negative * 100.0f / fs_count_lookup : 0.0f);
+    Com_Printf("Total directory rescans: %u\n", fs_count_rescan);
+    Com_Printf("Total async writes: %u, %u stalled, %u dropped\n",
+               fs_count_async_write, fs_count_async_stall, fs_count_async_drop);
 
     if (!totalHashSize) {
         Com_Printf("No stats to display\n");
@@ -3502,6 +4067,8 @@ static void free_all_paths(void)
 {
     searchpath_t *path, *next;
 
+    dircache_flush();
+
     for (path = fs_searchpaths; path; path = next) {
         next = path->next;
         free_search_path(path);
@@ -3514,6 +4081,8 @@ static void free_game_paths(void)
 {
     searchpath_t *path, *next;
 
+    dircache_flush();
+
     for (path = fs_searchpaths; path != fs_base_searchpaths; path = next) {
         next = path->next;
         free_search_path(path);
@@ -3806,6 +4375,8 @@ void FS_Init(void)
     Cmd_Register(c_fs);
 
     fs_autoexec = Cvar_Get("fs_autoexec", "1", 0);
+    fs_lookup_cache = Cvar_Get("fs_lookup_cache", "1000", 0);
+    fs_lookup_cache->changed = fs_lookup_cache_changed;
 
 #if USE_DEBUG
     fs_debug = Cvar_Get("fs_debug", "0", 0);
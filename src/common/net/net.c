@@ -60,6 +60,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #undef IP_RECVERR
 #undef IPV6_RECVERR
 #endif
+#if USE_EPOLL
+#include <sys/epoll.h>
+#endif
 #endif // !_WIN32
 
 // prevents infinite retry loops caused by broken TCP/IP stacks
@@ -125,6 +128,17 @@ static qhandle_t    net_logFile;
 static struct pollfd    io_entries[MAX_POLL_FDS];
 static int              io_numfds;
 
+#if USE_EPOLL
+// io_entries are still the API, epoll registrations mirror them
+static struct {
+    int     fd;         // registered descriptor, -1 if none
+    short   events;     // registered events
+    bool    always;     // not pollable by epoll, always ready like in poll()
+} io_epoll[MAX_POLL_FDS];
+static int              io_epfd = -1;
+static bool             io_epoll_failed;
+#endif
+
 // current rate measurement
 static unsigned     net_rate_time;
 static size_t       net_rate_rcvd;
@@ -389,6 +403,9 @@ static void logfile_open(void)
         }
     }
 
+    // packet dumps are large, don't let disk I/O stall the frame
+    mode |= FS_FLAG_ASYNC;
+
     f = FS_EasyOpenFile(buffer, sizeof(buffer), mode | FS_FLAG_TEXT,
                         "logs/", net_log_name->string, ".log");
     if (!f) {
@@ -424,6 +441,8 @@ NET_LogPacket
 static void NET_LogPacket(const netadr_t *address, const char *prefix,
                           const byte *data, size_t length)
 {
+    static const char hexchars[] = "0123456789abcdef";
+    char buffer[128], *p;
     int numRows;
     int i, j, c;
 
@@ -434,29 +453,36 @@ static void NET_LogPacket(const netadr_t *address, const char *prefix,
     FS_FPrintf(net_logFile, "%u : %s : %s : %zu bytes\n",
                com_localTime, prefix, NET_AdrToString(address), length);
 
+    // format each row in full, then write it at once
     numRows = (length + 15) / 16;
     for (i = 0; i < numRows; i++) {
-        FS_FPrintf(net_logFile, "%04x : ", i * 16);
+        p = buffer + Q_snprintf(buffer, sizeof(buffer), "%04x : ", i * 16);
         for (j = 0; j < 16; j++) {
             if (i * 16 + j < length) {
-                FS_FPrintf(net_logFile, "%02x ", data[i * 16 + j]);
+                c = data[i * 16 + j];
+                *p++ = hexchars[c >> 4];
+                *p++ = hexchars[c & 15];
             } else {
-                FS_FPrintf(net_logFile, "   ");
+                *p++ = ' ';
+                *p++ = ' ';
             }
+            *p++ = ' ';
         }
-        FS_FPrintf(net_logFile, ": ");
+        *p++ = ':';
+        *p++ = ' ';
         for (j = 0; j < 16; j++) {
             if (i * 16 + j < length) {
                 c = data[i * 16 + j];
-                FS_FPrintf(net_logFile, "%c", Q_isprint(c) ? c : '.');
+                *p++ = Q_isprint(c) ? c : '.';
             } else {
-                FS_FPrintf(net_logFile, " ");
+                *p++ = ' ';
             }
         }
-        FS_FPrintf(net_logFile, "\n");
+        *p++ = '\n';
+        FS_Write(buffer, p - buffer, net_logFile);
     }
 
-    FS_FPrintf(net_logFile, "\n");
+    FS_Write("\n", 1, net_logFile);
 }
 
 #else
@@ -690,6 +716,15 @@ void NET_FreePollFd(struct pollfd *e)
 {
     int i;
 
+#if USE_EPOLL
+    // sockets are usually closed by now, which already removed them from
+    // epoll set (EBADF/ENOENT), but stdin is freed at EOF and stays open
+    i = e - io_entries;
+    if (io_epfd != -1 && io_epoll[i].fd != -1 && !io_epoll[i].always)
+        epoll_ctl(io_epfd, EPOLL_CTL_DEL, io_epoll[i].fd, NULL);
+    io_epoll[i].fd = -1;
+#endif
+
     e->fd = -1;
     e->events = e->revents = 0;
 
@@ -702,6 +737,138 @@ void NET_FreePollFd(struct pollfd *e)
     io_numfds = i + 1;
 }
 
+#if USE_EPOLL
+
+static uint32_t epoll_events(short events)
+{
+    uint32_t ret = 0;
+
+    if (events & POLLIN)
+        ret |= EPOLLIN;
+    if (events & POLLOUT)
+        ret |= EPOLLOUT;
+
+    return ret;
+}
+
+static short poll_events(uint32_t events)
+{
+    short ret = 0;
+
+    if (events & EPOLLIN)
+        ret |= POLLIN;
+    if (events & EPOLLOUT)
+        ret |= POLLOUT;
+    if (events & EPOLLERR)
+        ret |= POLLERR;
+    if (events & EPOLLHUP)
+        ret |= POLLHUP;
+
+    return ret;
+}
+
+static bool epoll_register(int index)
+{
+    struct pollfd *e = &io_entries[index];
+    struct epoll_event ev = { .events = epoll_events(e->events), .data.u32 = index };
+
+    if (io_epoll[index].fd != e->fd) {
+        // descriptor changed without going through NET_FreePollFd
+        if (io_epoll[index].fd != -1)
+            epoll_ctl(io_epfd, EPOLL_CTL_DEL, io_epoll[index].fd, NULL);
+        io_epoll[index].fd = -1;
+    }
+
+    if (e->fd == -1)
+        return true;
+
+    if (io_epoll[index].fd == -1) {
+        io_epoll[index].always = false;
+        if (epoll_ctl(io_epfd, EPOLL_CTL_ADD, e->fd, &ev) == -1) {
+            // regular files and the like (e.g. stdin redirected from file)
+            if (errno != EPERM)
+                return false;
+            io_epoll[index].always = true;
+        }
+    } else if (io_epoll[index].always) {
+        // nothing to update
+    } else if (io_epoll[index].events != e->events) {
+        // descriptor number may have been reused after close
+        if (epoll_ctl(io_epfd, EPOLL_CTL_MOD, e->fd, &ev) == -1 &&
+            (errno != ENOENT || epoll_ctl(io_epfd, EPOLL_CTL_ADD, e->fd, &ev) == -1))
+            return false;
+    }
+
+    io_epoll[index].fd = e->fd;
+    io_epoll[index].events = e->events;
+    return true;
+}
+
+/*
+=============
+NET_SleepEpoll
+
+Level triggered, so that callers can leave data in socket buffers just like
+with poll(). Only descriptors with changed events cost a system call, and only
+ready descriptors are returned.
+=============
+*/
+static int NET_SleepEpoll(int msec)
+{
+    static struct epoll_event events[MAX_POLL_FDS];
+    int i, ret, ready;
+
+    if (io_epfd == -1) {
+        if (io_epoll_failed)
+            return os_poll(io_entries, io_numfds, msec);
+        io_epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (io_epfd == -1) {
+            Com_WPrintf("%s: %s, falling back to poll\n", __func__, strerror(errno));
+            io_epoll_failed = true;
+            return os_poll(io_entries, io_numfds, msec);
+        }
+        for (i = 0; i < MAX_POLL_FDS; i++)
+            io_epoll[i].fd = -1;
+    }
+
+    for (i = 0, ready = 0; i < io_numfds; i++) {
+        struct pollfd *e = &io_entries[i];
+
+        e->revents = 0;
+        if (!epoll_register(i)) {
+            // let the owner of this descriptor deal with it
+            Com_DPrintf("%s: %s\n", __func__, strerror(errno));
+            e->revents = POLLERR;
+            ready++;
+        } else if (io_epoll[i].always && e->fd != -1 && (e->events & (POLLIN | POLLOUT))) {
+            e->revents = e->events & (POLLIN | POLLOUT);
+            ready++;
+        }
+    }
+
+    ret = epoll_wait(io_epfd, events, q_countof(events), ready ? 0 : msec);
+    if (ret == -1) {
+        net_error = errno;
+        return net_error == EINTR ? ready : -1;
+    }
+
+    for (i = 0; i < ret; i++)
+        io_entries[events[i].data.u32].revents = poll_events(events[i].events);
+
+    return ret + ready;
+}
+
+static void NET_ShutdownEpoll(void)
+{
+    if (io_epfd != -1) {
+        close(io_epfd);
+        io_epfd = -1;
+    }
+    io_epoll_failed = false;
+}
+
+#endif // USE_EPOLL
+
 /*
 =============
 NET_Sleep
@@ -719,13 +886,39 @@ int NET_Sleep(int msec)
         return 0;
     }
 
+#if USE_EPOLL
+    ret = NET_SleepEpoll(msec);
+#else
     ret = os_poll(io_entries, io_numfds, msec);
+#endif
     if (ret == -1)
         Com_EPrintf("%s: %s\n", __func__, NET_ErrorString());
 
     return ret;
 }
 
+/*
+=============
+NET_SleepUntil
+
+Sleeps until Sys_Microseconds() reaches usec or some file descriptor is ready.
+Descriptors are only polled with millisecond precision, the fraction is slept
+off afterwards.
+=============
+*/
+int NET_SleepUntil(uint64_t usec)
+{
+    uint64_t now = Sys_Microseconds();
+    int ret;
+
+    ret = NET_Sleep(usec > now ? (usec - now) / 1000 : 0);
+    if (ret)
+        return ret;
+
+    Sys_SleepUntil(usec);
+    return 0;
+}
+
 #if USE_AC_SERVER
 
 /*
@@ -1883,6 +2076,9 @@ void NET_Shutdown(void)
 
     NET_Listen(false);
     NET_Config(NET_NONE);
+#if USE_EPOLL
+    NET_ShutdownEpoll();
+#endif
     os_net_shutdown();
 
     Cmd_RemoveCommand("net_restart");
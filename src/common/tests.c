@@ -21,7 +21,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cmd.h"
 #include "common/common.h"
 #include "common/files.h"
+#include "common/fifo.h"
 #include "common/mdfour.h"
+#include "common/net/net.h"
 #include "common/tests.h"
 #include "common/utils.h"
 #include "refresh/refresh.h"
@@ -857,6 +859,111 @@ static void Com_Extract_f(void)
         Com_Printf("Extracted %s (%d bytes)\n", path, len);
 }
 
+#define NETBENCH_BUFSIZE    256
+
+// connects a number of fake clients to ourselves over loopback TCP and
+// measures how long it takes to service them, most of them being idle
+static void Com_NetBench_f(void)
+{
+    int i, j, count, active, frames, connected, accepted, pending;
+    unsigned start, time;
+    neterr_t ret;
+    netstream_t *s;
+    netadr_t adr;
+    byte *buffers, junk[64] = { 0 };
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <connections> [active] [frames]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = Q_clip(Q_atoi(Cmd_Argv(1)), 1, 400);
+    active = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 0, count) : count / 10;
+    frames = Cmd_Argc() > 3 ? Q_clip(Q_atoi(Cmd_Argv(3)), 1, 100000) : 1000;
+
+    if (!NET_StringToAdr("127.0.0.1", &adr, Cvar_VariableInteger("net_port"))) {
+        Com_Printf("Couldn't resolve loopback address\n");
+        return;
+    }
+
+    ret = NET_Listen(true);
+    if (ret == NET_AGAIN) {
+        Com_Printf("Already listening on TCP port\n");
+        return;
+    }
+    if (ret == NET_ERROR) {
+        Com_Printf("Couldn't listen on TCP port: %s\n", NET_ErrorString());
+        return;
+    }
+
+    // even streams are clients, odd are accepted server sides
+    s = Z_Mallocz(sizeof(s[0]) * count * 2);
+    buffers = Z_Malloc(count * 4 * NETBENCH_BUFSIZE);
+
+    // don't overflow listen backlog
+    start = Sys_Milliseconds();
+    connected = accepted = pending = 0;
+    while (Sys_Milliseconds() - start < 5000) {
+        while (connected < count && connected - accepted < 16) {
+            if (NET_Connect(&adr, &s[connected * 2])) {
+                Com_Printf("Couldn't connect: %s\n", NET_ErrorString());
+                break;
+            }
+            connected++;
+        }
+        NET_Sleep(1);
+        pending = 0;
+        for (i = 0; i < connected; i++) {
+            NET_RunConnect(&s[i * 2]);
+            pending += s[i * 2].state == NS_CONNECTING;
+        }
+        while (accepted < connected && NET_Accept(&s[accepted * 2 + 1]) == NET_OK)
+            accepted++;
+        if (!pending && accepted == count)
+            break;
+    }
+
+    if (pending || accepted < count) {
+        Com_Printf("Only %d of %d connections established\n", accepted, count);
+        goto done;
+    }
+
+    for (i = 0; i < count * 2; i++) {
+        s[i].recv.data = buffers + (i * 2 + 0) * NETBENCH_BUFSIZE;
+        s[i].recv.size = NETBENCH_BUFSIZE;
+        s[i].send.data = buffers + (i * 2 + 1) * NETBENCH_BUFSIZE;
+        s[i].send.size = NETBENCH_BUFSIZE;
+        NET_UpdateStream(&s[i]);
+    }
+
+    start = Sys_Milliseconds();
+    for (j = 0; j < frames; j++) {
+        for (i = 0; i < active; i++) {
+            FIFO_Write(&s[i * 2].send, junk, sizeof(junk));
+            NET_UpdateStream(&s[i * 2]);
+        }
+
+        NET_Sleep(0);
+
+        for (i = 0; i < count * 2; i++) {
+            if (NET_RunStream(&s[i]) == NET_OK)
+                FIFO_Clear(&s[i].recv);
+            NET_UpdateStream(&s[i]);
+        }
+    }
+    time = Sys_Milliseconds() - start;
+
+    Com_Printf("%d connections (%d active), %d frames in %u ms, %.3f ms/frame\n",
+               count, active, frames, time, (float)time / frames);
+
+done:
+    for (i = 0; i < count * 2; i++)
+        NET_CloseStream(&s[i]);
+    Z_Free(buffers);
+    Z_Free(s);
+    NET_Listen(false);
+}
+
 #if USE_CLIENT
 // https://github.com/flenniken/utf8tests
 static void UTF8_Test_f(void)
@@ -919,6 +1026,7 @@ static const cmdreg_t c_test[] = {
     { "extcmptest", Com_ExtCmpTest_f },
     { "nextpathtest", Com_NextPathTest_f },
     { "extract", Com_Extract_f },
+    { "netbench", Com_NetBench_f },
     { NULL }
 };
 
@@ -808,6 +808,7 @@ void WriteGame(const char *filename, qboolean autosave);
 void ReadGame(const char *filename);
 void WriteLevel(const char *filename);
 void ReadLevel(const char *filename);
+void G_FinishSave(void);
 
 //============================================================================
 
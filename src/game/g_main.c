@@ -81,6 +81,8 @@ static void ShutdownGame(void)
 {
     gi.dprintf("==== ShutdownGame ====\n");
 
+    G_FinishSave();
+
     memset(&game, 0, sizeof(game));
 
     gi.FreeTags(TAG_LEVEL);
@@ -461,6 +463,8 @@ static void G_RunFrame(void)
     int     i;
     edict_t *ent;
 
+    G_FinishSave();
+
     level.framenum++;
     level.time = level.framenum * FRAMETIME;
 
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "g_local.h"
 #include "g_ptrs.h"
+#include "system/pthread.h"
 
 #if USE_ZLIB
 #include <zlib.h>
@@ -30,6 +31,24 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define gzFile                      FILE *
 #endif
 
+// whole savegame is serialized into memory first, then written to
+// (or read from) disk in one go
+typedef struct {
+    byte    *data;
+    size_t  size;
+    size_t  pos;
+} savebuf_t;
+
+// level file is compressed and written on a separate thread, engine
+// always calls back into the game before touching the file again
+static struct {
+    pthread_t   thread;
+    savebuf_t   buf;
+    char        filename[MAX_OSPATH];
+    bool        pending;
+    bool        failed;
+} save_writer;
+
 typedef struct {
     fieldtype_t type;
 #if USE_DEBUG
@@ -449,33 +468,58 @@ static const save_field_t gamefields[] = {
 
 //=========================================================
 
-static void write_data(void *buf, size_t len, gzFile f)
+static void free_buffer(savebuf_t *f)
+{
+    if (f->data)
+        gi.TagFree(f->data);
+    memset(f, 0, sizeof(*f));
+}
+
+static void grow_buffer(savebuf_t *f, size_t len)
 {
-    if (gzwrite(f, buf, len) != len) {
-        gzclose(f);
-        gi.error("%s: couldn't write %zu bytes", __func__, len);
+    byte *data;
+    size_t size;
+
+    if (len <= f->size - f->pos)
+        return;
+
+    size = max(f->size * 2, f->pos + len);
+    size = max(size, 0x10000);
+    data = gi.TagMalloc(size, TAG_GAME);
+    if (f->data) {
+        memcpy(data, f->data, f->pos);
+        gi.TagFree(f->data);
     }
+    f->data = data;
+    f->size = size;
 }
 
-static void write_short(gzFile f, int16_t v)
+static void write_data(const void *buf, size_t len, savebuf_t *f)
+{
+    grow_buffer(f, len);
+    memcpy(f->data + f->pos, buf, len);
+    f->pos += len;
+}
+
+static void write_short(savebuf_t *f, int16_t v)
 {
     v = LittleShort(v);
     write_data(&v, sizeof(v), f);
 }
 
-static void write_int(gzFile f, int32_t v)
+static void write_int(savebuf_t *f, int32_t v)
 {
     v = LittleLong(v);
     write_data(&v, sizeof(v), f);
 }
 
-static void write_float(gzFile f, float v)
+static void write_float(savebuf_t *f, float v)
 {
     v = LittleFloat(v);
     write_data(&v, sizeof(v), f);
 }
 
-static void write_string(gzFile f, char *s)
+static void write_string(savebuf_t *f, char *s)
 {
     size_t len;
 
@@ -486,21 +530,21 @@ static void write_string(gzFile f, char *s)
 
     len = strlen(s);
     if (len >= 65536) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: bad length", __func__);
     }
     write_int(f, len);
     write_data(s, len, f);
 }
 
-static void write_vector(gzFile f, vec_t *v)
+static void write_vector(savebuf_t *f, vec_t *v)
 {
     write_float(f, v[0]);
     write_float(f, v[1]);
     write_float(f, v[2]);
 }
 
-static void write_index(gzFile f, void *p, size_t size, const void *start, int max_index)
+static void write_index(savebuf_t *f, void *p, size_t size, const void *start, int max_index)
 {
     uintptr_t diff;
 
@@ -511,17 +555,17 @@ static void write_index(gzFile f, void *p, size_t size, const void *start, int m
 
     diff = (uintptr_t)p - (uintptr_t)start;
     if (diff > max_index * size) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: pointer out of range: %p", __func__, p);
     }
     if (diff % size) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: misaligned pointer: %p", __func__, p);
     }
     write_int(f, (int)(diff / size));
 }
 
-static void write_pointer(gzFile f, void *p, ptr_type_t type)
+static void write_pointer(savebuf_t *f, void *p, ptr_type_t type)
 {
     const save_ptr_t *ptr;
     int i;
@@ -538,11 +582,11 @@ static void write_pointer(gzFile f, void *p, ptr_type_t type)
         }
     }
 
-    gzclose(f);
+    free_buffer(f);
     gi.error("%s: unknown pointer: %p", __func__, p);
 }
 
-static void write_field(gzFile f, const save_field_t *field, void *base)
+static void write_field(savebuf_t *f, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
@@ -601,7 +645,7 @@ static void write_field(gzFile f, const save_field_t *field, void *base)
     }
 }
 
-static void write_fields(gzFile f, const save_field_t *fields, void *base)
+static void write_fields(savebuf_t *f, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
@@ -610,15 +654,18 @@ static void write_fields(gzFile f, const save_field_t *fields, void *base)
     }
 }
 
-static void read_data(void *buf, size_t len, gzFile f)
+static void read_data(void *buf, size_t len, savebuf_t *f)
 {
-    if (gzread(f, buf, len) != len) {
-        gzclose(f);
+    if (len > f->size - f->pos) {
+        free_buffer(f);
         gi.error("%s: couldn't read %zu bytes", __func__, len);
     }
+
+    memcpy(buf, f->data + f->pos, len);
+    f->pos += len;
 }
 
-static int read_short(gzFile f)
+static int read_short(savebuf_t *f)
 {
     int16_t v;
 
@@ -628,7 +675,7 @@ static int read_short(gzFile f)
     return v;
 }
 
-static int read_int(gzFile f)
+static int read_int(savebuf_t *f)
 {
     int32_t v;
 
@@ -638,7 +685,7 @@ static int read_int(gzFile f)
     return v;
 }
 
-static float read_float(gzFile f)
+static float read_float(savebuf_t *f)
 {
     float v;
 
@@ -648,7 +695,7 @@ static float read_float(gzFile f)
     return v;
 }
 
-static char *read_string(gzFile f)
+static char *read_string(savebuf_t *f)
 {
     int len;
     char *s;
@@ -659,7 +706,7 @@ static char *read_string(gzFile f)
     }
 
     if (len < 0 || len >= 65536) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: bad length", __func__);
     }
 
@@ -670,13 +717,13 @@ static char *read_string(gzFile f)
     return s;
 }
 
-static void read_zstring(gzFile f, char *s, size_t size)
+static void read_zstring(savebuf_t *f, char *s, size_t size)
 {
     int len;
 
     len = read_int(f);
     if (len < 0 || len >= size) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: bad length", __func__);
     }
 
@@ -684,14 +731,14 @@ static void read_zstring(gzFile f, char *s, size_t size)
     s[len] = 0;
 }
 
-static void read_vector(gzFile f, vec_t *v)
+static void read_vector(savebuf_t *f, vec_t *v)
 {
     v[0] = read_float(f);
     v[1] = read_float(f);
     v[2] = read_float(f);
 }
 
-static void *read_index(gzFile f, size_t size, const void *start, int max_index)
+static void *read_index(savebuf_t *f, size_t size, const void *start, int max_index)
 {
     int index;
     byte *p;
@@ -702,7 +749,7 @@ static void *read_index(gzFile f, size_t size, const void *start, int max_index)
     }
 
     if (index < 0 || index > max_index) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: bad index", __func__);
     }
 
@@ -710,7 +757,7 @@ static void *read_index(gzFile f, size_t size, const void *start, int max_index)
     return p;
 }
 
-static void *read_pointer(gzFile f, ptr_type_t type)
+static void *read_pointer(savebuf_t *f, ptr_type_t type)
 {
     int index;
     const save_ptr_t *ptr;
@@ -721,20 +768,20 @@ static void *read_pointer(gzFile f, ptr_type_t type)
     }
 
     if (index < 0 || index >= num_save_ptrs) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: bad index", __func__);
     }
 
     ptr = &save_ptrs[index];
     if (ptr->type != type) {
-        gzclose(f);
+        free_buffer(f);
         gi.error("%s: type mismatch", __func__);
     }
 
     return (void *)ptr->ptr;
 }
 
-static void read_field(gzFile f, const save_field_t *field, void *base)
+static void read_field(savebuf_t *f, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
@@ -793,7 +840,7 @@ static void read_field(gzFile f, const save_field_t *field, void *base)
     }
 }
 
-static void read_fields(gzFile f, const save_field_t *fields, void *base)
+static void read_fields(savebuf_t *f, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
@@ -820,6 +867,85 @@ static void check_gzip(int magic)
 #endif
 }
 
+static bool write_file(const char *filename, const savebuf_t *f)
+{
+    gzFile  file;
+    bool    ok;
+
+    file = gzopen(filename, "wb");
+    if (!file)
+        return false;
+
+    ok = gzwrite(file, f->data, f->pos) == f->pos;
+    return !gzclose(file) && ok;
+}
+
+// on return, size is the number of bytes read
+static void read_file(savebuf_t *f, const char *filename)
+{
+    gzFile  file;
+    int     ret;
+
+    file = gzopen(filename, "rb");
+    if (!file)
+        gi.error("Couldn't open %s", filename);
+
+    gzbuffer(file, 65536);
+
+    do {
+        grow_buffer(f, 0x10000);
+        ret = gzread(file, f->data + f->pos, f->size - f->pos);
+        if (ret > 0)
+            f->pos += ret;
+    } while (ret > 0);
+
+    gzclose(file);
+
+    if (ret < 0) {
+        free_buffer(f);
+        gi.error("Couldn't read %s", filename);
+    }
+
+    f->size = f->pos;
+    f->pos = 0;
+}
+
+static void *write_level_func(void *arg)
+{
+    save_writer.failed = !write_file(save_writer.filename, &save_writer.buf);
+    return NULL;
+}
+
+// waits for background level write, returns false if it failed
+static bool finish_write(void)
+{
+    bool ok = !save_writer.failed;
+
+    if (save_writer.pending) {
+        pthread_join(save_writer.thread, NULL);
+        save_writer.pending = false;
+        ok = !save_writer.failed;
+    }
+
+    free_buffer(&save_writer.buf);
+    save_writer.failed = false;
+    return ok;
+}
+
+/*
+============
+G_FinishSave
+
+Called each frame and on shutdown, so that background
+level write never outlives the operation that started it
+============
+*/
+void G_FinishSave(void)
+{
+    if (!finish_write())
+        gi.dprintf("Couldn't write %s\n", save_writer.filename);
+}
+
 /*
 ============
 WriteGame
@@ -836,66 +962,69 @@ last save position.
 */
 void WriteGame(const char *filename, qboolean autosave)
 {
-    gzFile  f;
+    savebuf_t f = { 0 };
     int     i;
 
     if (!autosave)
         SaveClientData();
 
-    f = gzopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    // level file must be complete before engine copies save directory
+    if (!finish_write())
+        gi.error("Couldn't write %s", save_writer.filename);
 
-    write_int(f, SAVE_MAGIC1);
-    write_int(f, SAVE_VERSION);
+    write_int(&f, SAVE_MAGIC1);
+    write_int(&f, SAVE_VERSION);
 
     game.autosaved = autosave;
-    write_fields(f, gamefields, &game);
+    write_fields(&f, gamefields, &game);
     game.autosaved = false;
 
     for (i = 0; i < game.maxclients; i++) {
-        write_fields(f, clientfields, &game.clients[i]);
+        write_fields(&f, clientfields, &game.clients[i]);
     }
 
-    if (gzclose(f))
+    if (!write_file(filename, &f)) {
+        free_buffer(&f);
         gi.error("Couldn't write %s", filename);
+    }
+
+    free_buffer(&f);
 }
 
 void ReadGame(const char *filename)
 {
-    gzFile  f;
+    savebuf_t f = { 0 };
     int     i;
 
-    gi.FreeTags(TAG_GAME);
+    if (!finish_write())
+        gi.dprintf("Couldn't write %s\n", save_writer.filename);
 
-    f = gzopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    gi.FreeTags(TAG_GAME);
 
-    gzbuffer(f, 65536);
+    read_file(&f, filename);
 
-    i = read_int(f);
+    i = read_int(&f);
     if (i != SAVE_MAGIC1) {
-        gzclose(f);
+        free_buffer(&f);
         check_gzip(i);
         gi.error("Not a Q2PRO save game");
     }
 
-    i = read_int(f);
+    i = read_int(&f);
     if (i != SAVE_VERSION) {
-        gzclose(f);
+        free_buffer(&f);
         gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
     }
 
-    read_fields(f, gamefields, &game);
+    read_fields(&f, gamefields, &game);
 
     // should agree with server's version
     if (game.maxclients != (int)maxclients->value) {
-        gzclose(f);
+        free_buffer(&f);
         gi.error("Savegame has bad maxclients");
     }
     if (game.maxentities <= game.maxclients || game.maxentities > game.csr.max_edicts) {
-        gzclose(f);
+        free_buffer(&f);
         gi.error("Savegame has bad maxentities");
     }
 
@@ -905,10 +1034,10 @@ void ReadGame(const char *filename)
 
     game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]), TAG_GAME);
     for (i = 0; i < game.maxclients; i++) {
-        read_fields(f, clientfields, &game.clients[i]);
+        read_fields(&f, clientfields, &game.clients[i]);
     }
 
-    gzclose(f);
+    free_buffer(&f);
 }
 
 //==========================================================
@@ -923,29 +1052,43 @@ void WriteLevel(const char *filename)
 {
     int     i;
     edict_t *ent;
-    gzFile  f;
+    savebuf_t f = { 0 };
 
-    f = gzopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    if (!finish_write())
+        gi.error("Couldn't write %s", save_writer.filename);
 
-    write_int(f, SAVE_MAGIC2);
-    write_int(f, SAVE_VERSION);
+    write_int(&f, SAVE_MAGIC2);
+    write_int(&f, SAVE_VERSION);
 
     // write out level_locals_t
-    write_fields(f, levelfields, &level);
+    write_fields(&f, levelfields, &level);
 
     // write out all the entities
     for (i = 0; i < globals.num_edicts; i++) {
         ent = &g_edicts[i];
         if (!ent->inuse)
             continue;
-        write_int(f, i);
-        write_fields(f, entityfields, ent);
+        write_int(&f, i);
+        write_fields(&f, entityfields, ent);
+    }
+    write_int(&f, -1);
+
+    if (Q_strlcpy(save_writer.filename, filename, sizeof(save_writer.filename))
+        >= sizeof(save_writer.filename)) {
+        free_buffer(&f);
+        gi.error("Oversize filename");
     }
-    write_int(f, -1);
 
-    if (gzclose(f))
+    // compress and write on a separate thread, returning to the engine
+    // (which usually proceeds to load the next map) right away
+    save_writer.buf = f;
+    if (!pthread_create(&save_writer.thread, NULL, write_level_func, NULL)) {
+        save_writer.pending = true;
+        return;
+    }
+
+    write_level_func(NULL);
+    if (!finish_write())
         gi.error("Couldn't write %s", filename);
 }
 
@@ -968,7 +1111,7 @@ No clients are connected yet.
 void ReadLevel(const char *filename)
 {
     int     entnum;
-    gzFile  f;
+    savebuf_t f = { 0 };
     int     i;
     edict_t *ent;
 
@@ -976,46 +1119,45 @@ void ReadLevel(const char *filename)
     // base state
     gi.FreeTags(TAG_LEVEL);
 
-    f = gzopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    if (!finish_write())
+        gi.dprintf("Couldn't write %s\n", save_writer.filename);
 
-    gzbuffer(f, 65536);
+    read_file(&f, filename);
 
     // wipe all the entities
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
     globals.num_edicts = game.maxclients + 1;
 
-    i = read_int(f);
+    i = read_int(&f);
     if (i != SAVE_MAGIC2) {
-        gzclose(f);
+        free_buffer(&f);
         check_gzip(i);
         gi.error("Not a Q2PRO save game");
     }
 
-    i = read_int(f);
+    i = read_int(&f);
     if (i != SAVE_VERSION) {
-        gzclose(f);
+        free_buffer(&f);
         gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
     }
 
     // load the level locals
-    read_fields(f, levelfields, &level);
+    read_fields(&f, levelfields, &level);
 
     // load all the entities
     while (1) {
-        entnum = read_int(f);
+        entnum = read_int(&f);
         if (entnum == -1)
             break;
         if (entnum < 0 || entnum >= game.maxentities) {
-            gzclose(f);
+            free_buffer(&f);
             gi.error("%s: bad entity number", __func__);
         }
         if (entnum >= globals.num_edicts)
             globals.num_edicts = entnum + 1;
 
         ent = &g_edicts[entnum];
-        read_fields(f, entityfields, ent);
+        read_fields(&f, entityfields, ent);
         ent->inuse = true;
         ent->s.number = entnum;
 
@@ -1024,7 +1166,7 @@ void ReadLevel(const char *filename)
         gi.linkentity(ent);
     }
 
-    gzclose(f);
+    free_buffer(&f);
 
     // mark all clients as unconnected
     for (i = 0; i < game.maxclients; i++) {
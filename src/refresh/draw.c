@@ -437,6 +437,7 @@ void Draw_Stats(void)
     Draw_Stringf(x, y, "Tex switches   : %i", c.texSwitches); y += 10;
     Draw_Stringf(x, y, "Tex uploads    : %i", c.texUploads); y += 10;
     Draw_Stringf(x, y, "LM texels      : %i", c.lightTexels); y += 10;
+    Draw_Stringf(x, y, "LM faces       : %i", c.lightFaces); y += 10;
     Draw_Stringf(x, y, "Batches drawn  : %i", c.batchesDrawn); y += 10;
     Draw_Stringf(x, y, "Faces / batch  : %.1f", c.batchesDrawn ? (float)c.facesDrawn / c.batchesDrawn : 0.0f); y += 10;
     Draw_Stringf(x, y, "Tris / batch   : %.1f", c.batchesDrawn ? (float)c.facesTris / c.batchesDrawn : 0.0f); y += 10;
@@ -447,6 +448,7 @@ void Draw_Stats(void)
     Draw_Stringf(x, y, "Uniform uploads: %i", c.uniformUploads); y += 10;
     Draw_Stringf(x, y, "Array binds    : %i", c.vertexArrayBinds); y += 10;
     Draw_Stringf(x, y, "Occl. queries  : %i", c.occlusionQueries); y += 10;
+    Draw_Stringf(x, y, "Mesh cache hits: %i/%i", c.meshCacheHits, c.meshCacheHits + c.meshCacheMisses); y += 10;
 
     R_SetScale(1.0f);
 }
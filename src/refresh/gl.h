@@ -216,6 +216,7 @@ typedef struct {
     int texSwitches;
     int texUploads;
     int lightTexels;
+    int lightFaces;
     int trisDrawn;
     int batchesDrawn;
     int nodesCulled;
@@ -228,6 +229,8 @@ typedef struct {
     int uniformUploads;
     int vertexArrayBinds;
     int occlusionQueries;
+    int meshCacheHits;
+    int meshCacheMisses;
 } statCounters_t;
 
 extern statCounters_t c;
@@ -420,6 +423,7 @@ typedef struct {
     uint16_t *indices;
     md5_weight_t *weights;
     uint8_t *jointnums;
+    float *skin_weights; // CPU skinning only: bias * pos[0..2] and bias planes
 } md5_mesh_t;
 
 /* MD5 model + animation structure */
@@ -959,6 +963,7 @@ void R_SetSky(const char *name, float rotate, bool autorotate, const vec3_t axis
  *
  */
 void GL_DrawAliasModel(const model_t *model);
+void GL_ClearMeshCache(void);
 
 /*
  * hq2x.c
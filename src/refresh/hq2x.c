@@ -26,6 +26,7 @@ written by Maxim Stepin (MaxSt). it is not 100% identical, but very similar.
 */
 
 #include "gl.h"
+#include "system/pthread.h"
 
 static const uint8_t hqTable[256] = {
     1, 1, 2,  4, 1, 1, 2,  4, 3,  5,  7,  8, 3,  5, 13, 15,
@@ -351,14 +352,77 @@ static q_noinline void hq4x_blend(int rule, uint32_t *p00, uint32_t *p01, uint32
     }
 }
 
-void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height)
+#define MAX_SLICES      16
+#define MIN_SLICE_ROWS  16
+
+typedef struct {
+    int32_t y, cb, cr, a;
+} ycc_t;
+
+typedef struct hqslice_s {
+    void            (*render)(const struct hqslice_s *);
+    uint32_t        *output;
+    const uint32_t  *input;
+    const ycc_t     *ycc;
+    int             width, height;
+    int             start, end;
+} hqslice_t;
+
+static int      numSlices = 1;
+
+static void ycc_convert(ycc_t *ycc, const uint32_t *input, int count)
+{
+    color_t c;
+    int i;
+
+    for (i = 0; i < count; i++, ycc++) {
+        c.u32 = input[i];
+        ycc->y  = yccTable[0][c.u8[0]] + yccTable[1][c.u8[1]] + yccTable[2][c.u8[2]];
+        ycc->cb = yccTable[3][c.u8[0]] + yccTable[4][c.u8[1]] + yccTable[5][c.u8[2]];
+        ycc->cr = yccTable[5][c.u8[0]] + yccTable[6][c.u8[1]] + yccTable[7][c.u8[2]];
+        ycc->a  = c.u8[3] != 0;
+    }
+}
+
+// same as diff(), but on pixels converted in advance
+static inline int ycc_diff(const ycc_t *A, const ycc_t *B)
 {
-    int x, y;
+    if (!A->a && !B->a)
+        return 0;
 
-    for (y = 0; y < height; y++) {
-        const uint32_t *in = input + y * width;
-        uint32_t *out0 = output + (y * 2 + 0) * width * 2;
-        uint32_t *out1 = output + (y * 2 + 1) * width * 2;
+    if (!A->a || !B->a)
+        return 1;
+
+    return abs(A->y  - B->y ) > maxY
+        || abs(A->cb - B->cb) > maxCb
+        || abs(A->cr - B->cr) > maxCr;
+}
+
+static inline int ycc_pattern(const ycc_t *e, int prevline, int nextline, int prev, int next)
+{
+    int pattern;
+
+    pattern  = ycc_diff(e, e - prevline - prev) << 0;
+    pattern |= ycc_diff(e, e - prevline       ) << 1;
+    pattern |= ycc_diff(e, e - prevline + next) << 2;
+    pattern |= ycc_diff(e, e            - prev) << 3;
+    pattern |= ycc_diff(e, e            + next) << 4;
+    pattern |= ycc_diff(e, e + nextline - prev) << 5;
+    pattern |= ycc_diff(e, e + nextline       ) << 6;
+    pattern |= ycc_diff(e, e + nextline + next) << 7;
+
+    return pattern;
+}
+
+static void hq2x_render_slice(const hqslice_t *s)
+{
+    int x, y, width = s->width, height = s->height;
+
+    for (y = s->start; y < s->end; y++) {
+        const uint32_t *in = s->input + y * width;
+        const ycc_t *e = s->ycc + y * width;
+        uint32_t *out0 = s->output + (y * 2 + 0) * width * 2;
+        uint32_t *out1 = s->output + (y * 2 + 1) * width * 2;
 
         int prevline = (y == 0 ? 0 : width);
         int nextline = (y == height - 1 ? 0 : width);
@@ -377,15 +441,7 @@ void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height)
             uint32_t H = *(in + nextline);
             uint32_t I = *(in + nextline + next);
 
-            int pattern;
-            pattern  = diff(E, A) << 0;
-            pattern |= diff(E, B) << 1;
-            pattern |= diff(E, C) << 2;
-            pattern |= diff(E, D) << 3;
-            pattern |= diff(E, F) << 4;
-            pattern |= diff(E, G) << 5;
-            pattern |= diff(E, H) << 6;
-            pattern |= diff(E, I) << 7;
+            int pattern = ycc_pattern(e, prevline, nextline, prev, next);
 
             *(out0 + 0) = hq2x_blend(hqTable[pattern], E, A, B, D, F, H); pattern = rotTable[pattern];
             *(out0 + 1) = hq2x_blend(hqTable[pattern], E, C, F, B, H, D); pattern = rotTable[pattern];
@@ -393,22 +449,24 @@ void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height)
             *(out1 + 0) = hq2x_blend(hqTable[pattern], E, G, D, H, B, F);
 
             in++;
+            e++;
             out0 += 2;
             out1 += 2;
         }
     }
 }
 
-void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
+static void hq4x_render_slice(const hqslice_t *s)
 {
-    int x, y;
+    int x, y, width = s->width, height = s->height;
 
-    for (y = 0; y < height; y++) {
-        const uint32_t *in = input + y * width;
-        uint32_t *out0 = output + (y * 4 + 0) * width * 4;
-        uint32_t *out1 = output + (y * 4 + 1) * width * 4;
-        uint32_t *out2 = output + (y * 4 + 2) * width * 4;
-        uint32_t *out3 = output + (y * 4 + 3) * width * 4;
+    for (y = s->start; y < s->end; y++) {
+        const uint32_t *in = s->input + y * width;
+        const ycc_t *e = s->ycc + y * width;
+        uint32_t *out0 = s->output + (y * 4 + 0) * width * 4;
+        uint32_t *out1 = s->output + (y * 4 + 1) * width * 4;
+        uint32_t *out2 = s->output + (y * 4 + 2) * width * 4;
+        uint32_t *out3 = s->output + (y * 4 + 3) * width * 4;
 
         int prevline = (y == 0 ? 0 : width);
         int nextline = (y == height - 1 ? 0 : width);
@@ -427,15 +485,7 @@ void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
             uint32_t H = *(in + nextline);
             uint32_t I = *(in + nextline + next);
 
-            int pattern;
-            pattern  = diff(E, A) << 0;
-            pattern |= diff(E, B) << 1;
-            pattern |= diff(E, C) << 2;
-            pattern |= diff(E, D) << 3;
-            pattern |= diff(E, F) << 4;
-            pattern |= diff(E, G) << 5;
-            pattern |= diff(E, H) << 6;
-            pattern |= diff(E, I) << 7;
+            int pattern = ycc_pattern(e, prevline, nextline, prev, next);
 
             hq4x_blend(hqTable[pattern], out0 + 0, out0 + 1, out1 + 0, out1 + 1, E, A, B, D, F, H); pattern = rotTable[pattern];
             hq4x_blend(hqTable[pattern], out0 + 3, out1 + 3, out0 + 2, out1 + 2, E, C, F, B, H, D); pattern = rotTable[pattern];
@@ -443,6 +493,7 @@ void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
             hq4x_blend(hqTable[pattern], out3 + 0, out2 + 0, out3 + 1, out2 + 1, E, G, D, H, B, F);
 
             in++;
+            e++;
             out0 += 4;
             out1 += 4;
             out2 += 4;
@@ -451,6 +502,77 @@ void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
     }
 }
 
+static void *slice_func(void *arg)
+{
+    hqslice_t *s = arg;
+
+    s->render(s);
+    return NULL;
+}
+
+/*
+=================
+render_slices
+
+Converts the whole image to YCbCr once, then splits output rows between
+worker threads. Each slice writes its own rows only, so the result doesn't
+depend on the number of slices.
+=================
+*/
+static void render_slices(void (*render)(const hqslice_t *),
+                          uint32_t *output, const uint32_t *input, int width, int height)
+{
+    hqslice_t   slices[MAX_SLICES];
+    pthread_t   threads[MAX_SLICES];
+    bool        started[MAX_SLICES];
+    ycc_t       *ycc;
+    int         i, count;
+
+    ycc = FS_AllocTempMem(width * height * sizeof(*ycc));
+    ycc_convert(ycc, input, width * height);
+
+    count = Q_clip(height / MIN_SLICE_ROWS, 1, numSlices);
+
+    for (i = 0; i < count; i++) {
+        slices[i] = (hqslice_t) {
+            .render = render,
+            .output = output,
+            .input = input,
+            .ycc = ycc,
+            .width = width,
+            .height = height,
+            .start = height * i / count,
+            .end = height * (i + 1) / count,
+        };
+    }
+
+    // slice 0 is rendered on the calling thread
+    for (i = 1; i < count; i++)
+        started[i] = !pthread_create(&threads[i], NULL, slice_func, &slices[i]);
+
+    render(&slices[0]);
+
+    // fall back to rendering slice inline if thread creation failed
+    for (i = 1; i < count; i++) {
+        if (started[i])
+            Q_assert(!pthread_join(threads[i], NULL));
+        else
+            render(&slices[i]);
+    }
+
+    FS_FreeTempMem(ycc);
+}
+
+void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height)
+{
+    render_slices(hq2x_render_slice, output, input, width, height);
+}
+
+void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
+{
+    render_slices(hq4x_render_slice, output, input, width, height);
+}
+
 #define FIX(x)      (int)((x) * (1 << 16))
 
 void HQ2x_Init(void)
@@ -460,11 +582,14 @@ void HQ2x_Init(void)
     cvar_t *hqx_y  = Cvar_Get("hqx_y", "48", CVAR_FILES);
     cvar_t *hqx_cb = Cvar_Get("hqx_cb", "7", CVAR_FILES);
     cvar_t *hqx_cr = Cvar_Get("hqx_cr", "6", CVAR_FILES);
+    cvar_t *hqx_threads = Cvar_Get("hqx_threads", "4", CVAR_FILES);
 
     maxY  = FIX(Cvar_ClampValue(hqx_y,  0, 256));
     maxCb = FIX(Cvar_ClampValue(hqx_cb, 0, 256));
     maxCr = FIX(Cvar_ClampValue(hqx_cr, 0, 256));
 
+    numSlices = Cvar_ClampInteger(hqx_threads, 1, MAX_SLICES);
+
     for (n = 0; n < 256; n++) {
         rotTable[n] = ((n >> 2) & 0x11) | ((n << 2) & 0x88)
                     | ((n & 0x01) << 5) | ((n & 0x08) << 3)
@@ -884,6 +884,8 @@ void R_BeginFrame(void)
 {
     memset(&c, 0, sizeof(c));
 
+    GL_ClearMeshCache();
+
     if (gl_finish->integer)
         qglFinish();
 
@@ -49,6 +49,7 @@ static mat4_t       m_shadow_model;     // fog hack
 
 #if USE_MD5
 static md5_joint_t  temp_skeleton[MD5_MAX_JOINTS];
+static vec4_t       skel_matrices[MD5_MAX_JOINTS][3];
 #endif
 
 static void setup_dotshading(void)
@@ -103,10 +104,9 @@ static inline vec_t *get_static_normal(vec3_t normal, const maliasvert_t *vert)
     return normal;
 }
 
-static void tess_static_shell(const maliasmesh_t *mesh)
+static void tess_static_shell(const maliasmesh_t *mesh, vec_t *restrict dst_vert)
 {
     const maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
-    vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
     vec3_t normal;
 
@@ -125,40 +125,36 @@ static void tess_static_shell(const maliasmesh_t *mesh)
     }
 }
 
-static void tess_static_shade(const maliasmesh_t *mesh)
+static void tess_static_plain(const maliasmesh_t *mesh, vec_t *restrict dst_vert)
 {
     const maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
-    vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
-    vec3_t normal;
 
     while (count--) {
-        vec_t d = shadedot(get_static_normal(normal, src_vert));
-
         dst_vert[0] = src_vert->pos[0] * newscale[0] + translate[0];
         dst_vert[1] = src_vert->pos[1] * newscale[1] + translate[1];
         dst_vert[2] = src_vert->pos[2] * newscale[2] + translate[2];
-        dst_vert[4] = color[0] * d;
-        dst_vert[5] = color[1] * d;
-        dst_vert[6] = color[2] * d;
-        dst_vert[7] = color[3];
-        dst_vert += VERTEX_SIZE;
+        dst_vert += 4;
 
         src_vert++;
     }
 }
 
-static void tess_static_plain(const maliasmesh_t *mesh)
+static void shade_static(const maliasmesh_t *mesh)
 {
     const maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
+    vec3_t normal;
 
     while (count--) {
-        dst_vert[0] = src_vert->pos[0] * newscale[0] + translate[0];
-        dst_vert[1] = src_vert->pos[1] * newscale[1] + translate[1];
-        dst_vert[2] = src_vert->pos[2] * newscale[2] + translate[2];
-        dst_vert += 4;
+        vec_t d = shadedot(get_static_normal(normal, src_vert));
+
+        dst_vert[4] = color[0] * d;
+        dst_vert[5] = color[1] * d;
+        dst_vert[6] = color[2] * d;
+        dst_vert[7] = color[3];
+        dst_vert += VERTEX_SIZE;
 
         src_vert++;
     }
@@ -183,11 +179,10 @@ static inline vec_t *get_lerped_normal(vec3_t normal,
     return normal;
 }
 
-static void tess_lerped_shell(const maliasmesh_t *mesh)
+static void tess_lerped_shell(const maliasmesh_t *mesh, vec_t *restrict dst_vert)
 {
     const maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
     const maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
-    vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
     vec3_t normal;
 
@@ -210,19 +205,13 @@ static void tess_lerped_shell(const maliasmesh_t *mesh)
     }
 }
 
-static void tess_lerped_shade(const maliasmesh_t *mesh)
+static void tess_lerped_plain(const maliasmesh_t *mesh, vec_t *restrict dst_vert)
 {
     const maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
     const maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
-    vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
-    vec3_t normal;
 
     while (count--) {
-        vec_t oldd = shadedot(get_static_normal(normal, src_oldvert));
-        vec_t newd = shadedot(get_static_normal(normal, src_newvert));
-        vec_t d = oldd * backlerp + newd * frontlerp;
-
         dst_vert[0] =
             src_oldvert->pos[0] * oldscale[0] +
             src_newvert->pos[0] * newscale[0] + translate[0];
@@ -232,41 +221,159 @@ static void tess_lerped_shade(const maliasmesh_t *mesh)
         dst_vert[2] =
             src_oldvert->pos[2] * oldscale[2] +
             src_newvert->pos[2] * newscale[2] + translate[2];
-        dst_vert[4] = color[0] * d;
-        dst_vert[5] = color[1] * d;
-        dst_vert[6] = color[2] * d;
-        dst_vert[7] = color[3];
-        dst_vert += VERTEX_SIZE;
+        dst_vert += 4;
 
         src_oldvert++;
         src_newvert++;
     }
 }
 
-static void tess_lerped_plain(const maliasmesh_t *mesh)
+static void shade_lerped(const maliasmesh_t *mesh)
 {
     const maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
     const maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
+    vec3_t normal;
 
     while (count--) {
-        dst_vert[0] =
-            src_oldvert->pos[0] * oldscale[0] +
-            src_newvert->pos[0] * newscale[0] + translate[0];
-        dst_vert[1] =
-            src_oldvert->pos[1] * oldscale[1] +
-            src_newvert->pos[1] * newscale[1] + translate[1];
-        dst_vert[2] =
-            src_oldvert->pos[2] * oldscale[2] +
-            src_newvert->pos[2] * newscale[2] + translate[2];
-        dst_vert += 4;
+        vec_t oldd = shadedot(get_static_normal(normal, src_oldvert));
+        vec_t newd = shadedot(get_static_normal(normal, src_newvert));
+        vec_t d = oldd * backlerp + newd * frontlerp;
+
+        dst_vert[4] = color[0] * d;
+        dst_vert[5] = color[1] * d;
+        dst_vert[6] = color[2] * d;
+        dst_vert[7] = color[3];
+        dst_vert += VERTEX_SIZE;
 
         src_oldvert++;
         src_newvert++;
     }
 }
 
+/*
+=============================================================================
+
+MESH CACHE
+
+Positions of interpolated vertices only depend on mesh, frame numbers,
+backlerp and shell scale, so they can be shared by all entities drawn
+with the same parameters within a frame (and by all views rendered in
+that frame). Lighting is applied on top of cached positions.
+
+=============================================================================
+*/
+
+#define MESH_CACHE_ENTRIES  256
+#define MESH_CACHE_VERTS    0x10000
+
+typedef struct {
+    const maliasmesh_t  *mesh;
+    unsigned            oldframe;
+    unsigned            newframe;
+    uint32_t            backlerp;
+    uint32_t            shellscale;
+    vec_t               *verts;
+} meshcache_entry_t;
+
+static struct {
+    meshcache_entry_t   entries[MESH_CACHE_ENTRIES];
+    int                 numentries;
+    int                 numverts;
+    vec_t               verts[MESH_CACHE_VERTS * 4];
+    vec_t               scratch[TESS_MAX_VERTICES * 4];
+} meshcache;
+
+static void (*tess_positions)(const maliasmesh_t *, vec_t *restrict);
+
+static uint32_t float_bits(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+static const vec_t *cached_positions(const maliasmesh_t *mesh)
+{
+    meshcache_entry_t *e;
+    uint32_t lerp = oldframenum == newframenum ? 0 : float_bits(backlerp);
+    uint32_t shell = glr.ent->flags & RF_SHELL_MASK ? float_bits(shellscale) : 0;
+    uint32_t hash = (uint32_t)((uintptr_t)mesh >> 4);
+    int i;
+
+    hash = hash * 31 + oldframenum;
+    hash = hash * 31 + newframenum;
+    hash = hash * 31 + lerp;
+    hash = hash * 31 + shell;
+
+    for (i = 0; i < MESH_CACHE_ENTRIES; i++) {
+        e = &meshcache.entries[(hash + i) & (MESH_CACHE_ENTRIES - 1)];
+        if (!e->mesh)
+            break;
+        if (e->mesh == mesh && e->oldframe == oldframenum && e->newframe == newframenum &&
+            e->backlerp == lerp && e->shellscale == shell) {
+            c.meshCacheHits++;
+            return e->verts;
+        }
+    }
+
+    c.meshCacheMisses++;
+
+    // keep the table at most half full
+    if (meshcache.numentries >= MESH_CACHE_ENTRIES / 2 ||
+        meshcache.numverts + mesh->numverts > MESH_CACHE_VERTS) {
+        tess_positions(mesh, meshcache.scratch);
+        return meshcache.scratch;
+    }
+
+    e->mesh = mesh;
+    e->oldframe = oldframenum;
+    e->newframe = newframenum;
+    e->backlerp = lerp;
+    e->shellscale = shell;
+    e->verts = &meshcache.verts[meshcache.numverts * 4];
+
+    meshcache.numentries++;
+    meshcache.numverts += mesh->numverts;
+
+    tess_positions(mesh, e->verts);
+    return e->verts;
+}
+
+void GL_ClearMeshCache(void)
+{
+    if (!meshcache.numentries)
+        return;
+
+    memset(meshcache.entries, 0, sizeof(meshcache.entries));
+    meshcache.numentries = 0;
+    meshcache.numverts = 0;
+}
+
+static void tess_alias_mesh(const maliasmesh_t *mesh)
+{
+    const vec_t *src_vert = cached_positions(mesh);
+    vec_t *dst_vert = tess.vertices;
+    int count = mesh->numverts;
+
+    if (!dotshading) {
+        memcpy(dst_vert, src_vert, count * 4 * sizeof(dst_vert[0]));
+        return;
+    }
+
+    while (count--) {
+        VectorCopy(src_vert, dst_vert);
+        src_vert += 4;
+        dst_vert += VERTEX_SIZE;
+    }
+
+    if (newframenum == oldframenum)
+        shade_static(mesh);
+    else
+        shade_lerped(mesh);
+}
+
 static glCullResult_t cull_static_model(const model_t *model)
 {
     const maliasframe_t *newframe = &model->frames[newframenum];
@@ -741,30 +848,57 @@ static void draw_alias_mesh(const uint16_t *indices, int num_indices,
 
 // for the given vertex, set of weights & skeleton, calculate
 // the output vertex (and optionally normal).
+//
+// weights are premultiplied by bias and joint scale is folded into joint
+// matrix, so each weight is just a 3x4 matrix by vector multiply. normal
+// is rotated once by bias weighted sum of joint axes.
 static q_forceinline void calc_skel_vert(const md5_vertex_t *vert,
                                          const md5_mesh_t *mesh,
                                          const md5_joint_t *skeleton,
                                          float *restrict out_position,
                                          float *restrict out_normal)
 {
-    VectorClear(out_position);
+    const float *wx = mesh->skin_weights;
+    const float *wy = wx + mesh->num_weights;
+    const float *wz = wy + mesh->num_weights;
+    const float *wb = wz + mesh->num_weights;
+    vec3_t axis[3];
+    float x = 0, y = 0, z = 0;
 
     if (out_normal)
-        VectorClear(out_normal);
+        memset(axis, 0, sizeof(axis));
 
-    for (int i = 0; i < vert->count; i++) {
-        const md5_weight_t *weight = &mesh->weights[vert->start + i];
-        const md5_joint_t *joint = &skeleton[mesh->jointnums[vert->start + i]];
+    for (int i = vert->start; i < vert->start + vert->count; i++) {
+        const vec4_t *m = skel_matrices[mesh->jointnums[i]];
 
-        vec3_t wv;
-        VectorRotate(weight->pos, joint->axis, wv);
-
-        VectorMA(joint->pos, joint->scale, wv, wv);
-        VectorMA(out_position, weight->bias, wv, out_position);
+        x += m[0][0] * wx[i] + m[0][1] * wy[i] + m[0][2] * wz[i] + m[0][3] * wb[i];
+        y += m[1][0] * wx[i] + m[1][1] * wy[i] + m[1][2] * wz[i] + m[1][3] * wb[i];
+        z += m[2][0] * wx[i] + m[2][1] * wy[i] + m[2][2] * wz[i] + m[2][3] * wb[i];
 
         if (out_normal) {
-            VectorRotate(vert->normal, joint->axis, wv);
-            VectorMA(out_normal, weight->bias, wv, out_normal);
+            const md5_joint_t *joint = &skeleton[mesh->jointnums[i]];
+            VectorMA(axis[0], wb[i], joint->axis[0], axis[0]);
+            VectorMA(axis[1], wb[i], joint->axis[1], axis[1]);
+            VectorMA(axis[2], wb[i], joint->axis[2], axis[2]);
+        }
+    }
+
+    out_position[0] = x;
+    out_position[1] = y;
+    out_position[2] = z;
+
+    if (out_normal)
+        VectorRotate(vert->normal, axis, out_normal);
+}
+
+// builds 3x4 joint matrices for calc_skel_vert
+static void setup_skel_matrices(const md5_model_t *model, const md5_joint_t *skel)
+{
+    for (int i = 0; i < model->num_joints; i++, skel++) {
+        vec4_t *m = skel_matrices[i];
+        for (int j = 0; j < 3; j++) {
+            VectorScale(skel->axis[j], skel->scale, m[j]);
+            m[j][3] = skel->pos[j];
         }
     }
 }
@@ -897,6 +1031,8 @@ static void draw_alias_skeleton(const md5_model_t *model)
 
         meshbits &= ~GLS_MESH_MD2;
         meshbits |=  GLS_MESH_MD5 | GLS_MESH_LERP;
+    } else {
+        setup_skel_matrices(model, skel);
     }
 
     for (int i = 0; i < model->num_meshes; i++)
@@ -1028,15 +1164,14 @@ void GL_DrawAliasModel(const model_t *model)
         GL_BindArrays(dotshading ? VA_MESH_SHADE : VA_MESH_FLAT);
         meshbits = 0;
 
-        // select proper tessfunc
+        tessfunc = tess_alias_mesh;
+
+        // select proper position function
         if (ent->flags & RF_SHELL_MASK) {
-            tessfunc = newframenum == oldframenum ?
+            tess_positions = newframenum == oldframenum ?
                 tess_static_shell : tess_lerped_shell;
-        } else if (dotshading) {
-            tessfunc = newframenum == oldframenum ?
-                tess_static_shade : tess_lerped_shade;
         } else {
-            tessfunc = newframenum == oldframenum ?
+            tess_positions = newframenum == oldframenum ?
                 tess_static_plain : tess_lerped_plain;
         }
     }
@@ -1061,6 +1061,18 @@ static bool MD5_ParseMesh(model_t *model, const char *s, const char *path)
                 MD5_ParseError("Bad vert start/count");
         }
 
+        // build planar weight streams for CPU skinning
+        if (!gl_static.use_gpu_lerp) {
+            float *w = mesh->skin_weights = MD5_CpuMalloc(mesh->num_weights * 4 * sizeof(float));
+            for (j = 0; j < mesh->num_weights; j++) {
+                const md5_weight_t *weight = &mesh->weights[j];
+                w[mesh->num_weights * 0 + j] = weight->pos[0] * weight->bias;
+                w[mesh->num_weights * 1 + j] = weight->pos[1] * weight->bias;
+                w[mesh->num_weights * 2 + j] = weight->pos[2] * weight->bias;
+                w[mesh->num_weights * 3 + j] = weight->bias;
+            }
+        }
+
         MD5_ComputeNormals(mesh, base_skeleton);
     }
 
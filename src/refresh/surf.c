@@ -96,15 +96,28 @@ DYNAMIC BLOCKLIGHTS
 #define MAX_LIGHTMAP_EXTENTS    513
 #define MAX_BLOCKLIGHTS         (MAX_LIGHTMAP_EXTENTS * MAX_LIGHTMAP_EXTENTS)
 
+#define MAX_DIRTY_FACES         4096
+
 #define LM_PIXELS(map, s, t)    ((map)->buffer + ((t) << lm.block_shift) + ((s) << 2))
 
-static float blocklights[MAX_BLOCKLIGHTS * 3];
+// blocklights are stored as separate R, G, B planes so that the loops
+// below don't have any cross-lane dependencies and can be vectorized
+typedef struct {
+    float   r[MAX_BLOCKLIGHTS];
+    float   g[MAX_BLOCKLIGHTS];
+    float   b[MAX_BLOCKLIGHTS];
+} blocklights_t;
+
+static blocklights_t blocklights;
 
-static void put_blocklights(const mface_t *surf)
+// faces with lightmaps that need to be rebuilt before next upload
+static mface_t  *dirty_faces[MAX_DIRTY_FACES];
+static int      num_dirty_faces;
+
+static void put_blocklights(const mface_t *surf, const blocklights_t *bl)
 {
     float add, modulate, scale = lm.scale;
-    int i, j, smax, tmax, stride = 1 << lm.block_shift;
-    const float *bl;
+    int i, j, k, smax, tmax, stride = 1 << lm.block_shift;
     byte *out;
 
     if (gl_static.use_shaders) {
@@ -120,28 +133,47 @@ static void put_blocklights(const mface_t *surf)
 
     out = LM_PIXELS(surf->light_m, surf->light_s, surf->light_t);
 
-    for (i = 0, bl = blocklights; i < tmax; i++, out += stride) {
-        byte *dst;
-        for (j = 0, dst = out; j < smax; j++, bl += 3, dst += 4) {
-            vec3_t tmp;
-            adjust_color_f(tmp, bl, add, modulate, scale);
-            dst[0] = (byte)tmp[0];
-            dst[1] = (byte)tmp[1];
-            dst[2] = (byte)tmp[2];
+    // this is adjust_color_f() unrolled over the row
+    for (i = k = 0; i < tmax; i++, k += smax, out += stride) {
+        const float *br = bl->r + k;
+        const float *bg = bl->g + k;
+        const float *bb = bl->b + k;
+        byte *dst = out;
+
+        for (j = 0; j < smax; j++, dst += 4) {
+            float r = max((br[j] + add) * modulate, 0.0f);
+            float g = max((bg[j] + add) * modulate, 0.0f);
+            float b = max((bb[j] + add) * modulate, 0.0f);
+            float m = max(max(r, g), b);
+            float y = m > 255 ? 255.0f / m : 1.0f;
+
+            r *= y;
+            g *= y;
+            b *= y;
+
+            if (scale != 1) {
+                y = LUMINANCE(r, g, b);
+                r = y + (r - y) * scale;
+                g = y + (g - y) * scale;
+                b = y + (b - y) * scale;
+            }
+
+            dst[0] = (byte)r;
+            dst[1] = (byte)g;
+            dst[2] = (byte)b;
             dst[3] = 255;
         }
     }
 }
 
-static void add_dynamic_lights(const mface_t *surf)
+static void add_dynamic_lights(const mface_t *surf, blocklights_t *bl)
 {
     const dlight_t  *light;
     vec3_t          point;
     vec2_t          local;
     vec_t           s_scale, t_scale, sd, td;
     vec_t           dist, rad, minlight, scale, frac;
-    float           *bl;
-    int             i, smax, tmax, s, t;
+    int             i, k, smax, tmax, s, t;
 
     smax = surf->lm_width;
     tmax = surf->lm_height;
@@ -171,98 +203,130 @@ static void add_dynamic_lights(const mface_t *surf)
         local[0] = DotProduct(point, surf->lm_axis[0]) + surf->lm_offset[0];
         local[1] = DotProduct(point, surf->lm_axis[1]) + surf->lm_offset[1];
 
-        bl = blocklights;
-        for (t = 0; t < tmax; t++) {
+        for (t = k = 0; t < tmax; t++, k += smax) {
+            float *br = bl->r + k;
+            float *bg = bl->g + k;
+            float *bb = bl->b + k;
+
             td = fabsf(local[1] - t) * t_scale;
             for (s = 0; s < smax; s++) {
                 sd = fabsf(local[0] - s) * s_scale;
-                if (sd > td)
-                    dist = sd + td * 0.5f;
-                else
-                    dist = td + sd * 0.5f;
-                if (dist < minlight) {
-                    frac = rad - dist * scale;
-                    VectorMA(bl, frac, light->color, bl);
-                }
-                bl += 3;
+                dist = max(sd, td) + min(sd, td) * 0.5f;
+                frac = dist < minlight ? rad - dist * scale : 0;
+                br[s] += frac * light->color[0];
+                bg[s] += frac * light->color[1];
+                bb[s] += frac * light->color[2];
             }
         }
     }
 }
 
-static void add_light_styles(mface_t *surf)
+static void add_light_styles(mface_t *surf, blocklights_t *bl)
 {
     const lightstyle_t *style;
     const byte *src;
-    float *bl;
+    float white;
     int i, j, size = surf->lm_width * surf->lm_height;
 
     if (!surf->numstyles) {
         // should this ever happen?
-        memset(blocklights, 0, sizeof(blocklights[0]) * size * 3);
+        memset(bl->r, 0, sizeof(bl->r[0]) * size);
+        memset(bl->g, 0, sizeof(bl->g[0]) * size);
+        memset(bl->b, 0, sizeof(bl->b[0]) * size);
         return;
     }
 
     // init primary lightmap
     style = LIGHT_STYLE(surf->styles[0]);
+    white = style->white;
 
     src = surf->lightmap;
-    bl = blocklights;
-    if (style->white == 1) {
-        for (j = 0; j < size; j++, bl += 3, src += 3)
-            VectorCopy(src, bl);
-    } else {
-        for (j = 0; j < size; j++, bl += 3, src += 3)
-            VectorScale(src, style->white, bl);
+    for (j = 0; j < size; j++, src += 3) {
+        bl->r[j] = src[0] * white;
+        bl->g[j] = src[1] * white;
+        bl->b[j] = src[2] * white;
     }
 
-    surf->stylecache[0] = style->white;
+    surf->stylecache[0] = white;
 
     // add remaining lightmaps
     for (i = 1; i < surf->numstyles; i++) {
         style = LIGHT_STYLE(surf->styles[i]);
+        white = style->white;
 
-        bl = blocklights;
-        for (j = 0; j < size; j++, bl += 3, src += 3)
-            VectorMA(bl, style->white, src, bl);
+        for (j = 0; j < size; j++, src += 3) {
+            bl->r[j] += src[0] * white;
+            bl->g[j] += src[1] * white;
+            bl->b[j] += src[2] * white;
+        }
 
-        surf->stylecache[i] = style->white;
+        surf->stylecache[i] = white;
     }
 }
 
-static void update_dynamic_lightmap(mface_t *surf)
+static void update_dynamic_lightmap(mface_t *surf, blocklights_t *bl)
 {
-    int s0, t0, s1, t1;
-
     // add all the lightmaps
-    add_light_styles(surf);
+    add_light_styles(surf, bl);
 
     // add all the dynamic lights
     if (surf->dlightframe == glr.dlightframe)
-        add_dynamic_lights(surf);
+        add_dynamic_lights(surf, bl);
     else
         surf->dlightframe = 0;
 
     // put into texture format
-    put_blocklights(surf);
+    put_blocklights(surf, bl);
+}
+
+// rebuilds a range of dirty faces. faces never share lightmap texels, so
+// this can be split between threads as long as each has its own blocklights.
+static void update_dynamic_lightmaps(mface_t **faces, int count, blocklights_t *bl)
+{
+    for (int i = 0; i < count; i++)
+        update_dynamic_lightmap(faces[i], bl);
+}
+
+// rebuilds all faces queued by GL_PushLights and adds them to dirty regions
+static void flush_dynamic_lightmaps(void)
+{
+    int i, s0, t0, s1, t1;
 
-    // add to dirty region
-    s0 = surf->light_s;
-    t0 = surf->light_t;
+    if (!num_dirty_faces)
+        return;
 
-    s1 = s0 + surf->lm_width;
-    t1 = t0 + surf->lm_height;
+    update_dynamic_lightmaps(dirty_faces, num_dirty_faces, &blocklights);
 
-    lightmap_t *m = surf->light_m;
+    for (i = 0; i < num_dirty_faces; i++) {
+        const mface_t *surf = dirty_faces[i];
+        lightmap_t *m = surf->light_m;
 
-    m->mins[0] = min(m->mins[0], s0);
-    m->mins[1] = min(m->mins[1], t0);
+        s0 = surf->light_s;
+        t0 = surf->light_t;
 
-    m->maxs[0] = max(m->maxs[0], s1);
-    m->maxs[1] = max(m->maxs[1], t1);
+        s1 = s0 + surf->lm_width;
+        t1 = t0 + surf->lm_height;
+
+        m->mins[0] = min(m->mins[0], s0);
+        m->mins[1] = min(m->mins[1], t0);
+
+        m->maxs[0] = max(m->maxs[0], s1);
+        m->maxs[1] = max(m->maxs[1], t1);
+    }
+
+    c.lightFaces += num_dirty_faces;
+    num_dirty_faces = 0;
+}
+
+static void queue_dynamic_lightmap(mface_t *surf)
+{
+    if (num_dirty_faces == MAX_DIRTY_FACES)
+        flush_dynamic_lightmaps();
+
+    dirty_faces[num_dirty_faces++] = surf;
 }
 
-// updates lightmaps in RAM
+// queues lightmap update in RAM, actual work is done in GL_UploadLightmaps
 void GL_PushLights(mface_t *surf)
 {
     const lightstyle_t *style;
@@ -273,7 +337,7 @@ void GL_PushLights(mface_t *surf)
 
     // dynamic this frame or dynamic previously
     if (surf->dlightframe) {
-        update_dynamic_lightmap(surf);
+        queue_dynamic_lightmap(surf);
         return;
     }
 
@@ -281,7 +345,7 @@ void GL_PushLights(mface_t *surf)
     for (i = 0; i < surf->numstyles; i++) {
         style = LIGHT_STYLE(surf->styles[i]);
         if (style->white != surf->stylecache[i]) {
-            update_dynamic_lightmap(surf);
+            queue_dynamic_lightmap(surf);
             return;
         }
     }
@@ -302,6 +366,10 @@ void GL_UploadLightmaps(void)
     bool set = false;
     int i;
 
+    // dynamic lights are in model space, so this must be done
+    // before the next inline model transforms them
+    flush_dynamic_lightmaps();
+
     for (i = 0, m = lm.lightmaps; i < lm.nummaps; i++, m++) {
         int x, y, w, h;
 
@@ -455,12 +523,12 @@ static void LM_EndBuilding(void)
 static void build_primary_lightmap(mface_t *surf)
 {
     // add all the lightmaps
-    add_light_styles(surf);
+    add_light_styles(surf, &blocklights);
 
     surf->dlightframe = 0;
 
     // put into texture format
-    put_blocklights(surf);
+    put_blocklights(surf, &blocklights);
 }
 
 static void LM_BuildSurface(mface_t *surf)
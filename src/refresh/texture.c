@@ -196,63 +196,67 @@ IMAGE PROCESSING
 =========================================================
 */
 
+// spread RGBA bytes into 16-bit lanes so that all 4 channels can be
+// summed at once without overflowing into each other
+static inline uint64_t IMG_Spread(uint32_t n)
+{
+    uint64_t v = n;
+    v |= v << 24;
+    v &= UINT64_C(0xff00ff00ff00ff);
+    return v;
+}
+
+static inline uint32_t IMG_Average4(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    uint64_t v = IMG_Spread(a) + IMG_Spread(b) + IMG_Spread(c) + IMG_Spread(d);
+    v = (v >> 2) & UINT64_C(0xff00ff00ff00ff);
+    return v | v >> 24;
+}
+
 static void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
                                 byte *out, int outwidth, int outheight)
 {
-    int         i, j;
-    const byte  *inrow1, *inrow2;
-    unsigned    frac, fracstep;
-    unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
-    const byte  *pix1, *pix2, *pix3, *pix4;
-    float       heightScale;
+    int             i, j;
+    const uint32_t  *inrow1, *inrow2;
+    uint32_t        *dst = (uint32_t *)out;
+    unsigned        frac, fracstep;
+    unsigned        p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
+    float           heightScale;
 
     Q_assert(outwidth <= MAX_TEXTURE_SIZE);
     fracstep = inwidth * 0x10000 / outwidth;
 
     frac = fracstep >> 2;
     for (i = 0; i < outwidth; i++) {
-        p1[i] = 4 * (frac >> 16);
+        p1[i] = frac >> 16;
         frac += fracstep;
     }
     frac = 3 * (fracstep >> 2);
     for (i = 0; i < outwidth; i++) {
-        p2[i] = 4 * (frac >> 16);
+        p2[i] = frac >> 16;
         frac += fracstep;
     }
 
     heightScale = (float)inheight / outheight;
-    inwidth <<= 2;
     for (i = 0; i < outheight; i++) {
-        inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
-        inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
-            pix1 = inrow1 + p1[j];
-            pix2 = inrow1 + p2[j];
-            pix3 = inrow2 + p1[j];
-            pix4 = inrow2 + p2[j];
-            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
-            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
-            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
-            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
-            out += 4;
-        }
+        inrow1 = (const uint32_t *)in + inwidth * (int)((i + 0.25f) * heightScale);
+        inrow2 = (const uint32_t *)in + inwidth * (int)((i + 0.75f) * heightScale);
+        for (j = 0; j < outwidth; j++)
+            *dst++ = IMG_Average4(inrow1[p1[j]], inrow1[p2[j]],
+                                  inrow2[p1[j]], inrow2[p2[j]]);
     }
 }
 
 static void IMG_MipMap(byte *out, const byte *in, int width, int height)
 {
-    int     i, j;
+    const uint32_t  *src = (const uint32_t *)in;
+    uint32_t        *dst = (uint32_t *)out;
+    int             i, j;
 
-    width <<= 2;
     height >>= 1;
-    for (i = 0; i < height; i++, in += width) {
-        for (j = 0; j < width; j += 8, out += 4, in += 8) {
-            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
-            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
-            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
-            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
-        }
-    }
+    for (i = 0; i < height; i++, src += width)
+        for (j = 0; j < width; j += 2, dst++, src += 2)
+            *dst = IMG_Average4(src[0], src[1], src[width], src[width + 1]);
 }
 
 /*
@@ -362,59 +366,46 @@ static int GL_GrayScaleTexture(byte *in, int inwidth, int inheight, imagetype_t
 
 /*
 ================
-GL_LightScaleTexture
+GL_ColorScaleTexture
 
 Scale up the pixel values in a texture to increase the
-lighting range
+lighting range, and optionally invert colors. Both are
+merged into a single remap table applied in one pass.
 ================
 */
-static void GL_LightScaleTexture(byte *in, int inwidth, int inheight, imagetype_t type, imageflags_t flags)
+static void GL_ColorScaleTexture(byte *in, int inwidth, int inheight, imagetype_t type, imageflags_t flags)
 {
-    int     i, c;
-    byte    *p;
-
-    if (r_config.flags & QVF_GAMMARAMP)
-        return;
-    if (!lightscale)
-        return;
+    const byte  *table = NULL;
+    byte        remap[256];
+    bool        invert;
+    int         i, c;
+    byte        *p;
 
-    p = in;
-    c = inwidth * inheight;
-
-    if (type == IT_WALL || type == IT_SKIN) {
-        for (i = 0; i < c; i++, p += 4) {
-            p[0] = gammaintensitytable[p[0]];
-            p[1] = gammaintensitytable[p[1]];
-            p[2] = gammaintensitytable[p[2]];
-        }
-    } else if (gl_gamma_scale_pics->integer) {
-        for (i = 0; i < c; i++, p += 4) {
-            p[0] = gammatable[p[0]];
-            p[1] = gammatable[p[1]];
-            p[2] = gammatable[p[2]];
-        }
+    if (!(r_config.flags & QVF_GAMMARAMP) && lightscale) {
+        if (type == IT_WALL || type == IT_SKIN)
+            table = gammaintensitytable;
+        else if (gl_gamma_scale_pics->integer)
+            table = gammatable;
     }
-}
 
-static void GL_ColorInvertTexture(byte *in, int inwidth, int inheight, imagetype_t type, imageflags_t flags)
-{
-    int     i, c;
-    byte    *p;
+    // only invert world textures, but not turbulent surfaces
+    invert = type == IT_WALL && !(flags & IF_TURBULENT) && gl_invert->integer;
 
-    if (type != IT_WALL)
-        return; // only invert world textures
-    if (flags & IF_TURBULENT)
-        return; // don't invert turbulent surfaces
-    if (!gl_invert->integer)
+    if (!table && !invert)
         return;
 
+    for (i = 0; i < 256; i++) {
+        c = table ? table[i] : i;
+        remap[i] = invert ? 255 - c : c;
+    }
+
     p = in;
     c = inwidth * inheight;
 
     for (i = 0; i < c; i++, p += 4) {
-        p[0] = 255 - p[0];
-        p[1] = 255 - p[1];
-        p[2] = 255 - p[2];
+        p[0] = remap[p[0]];
+        p[1] = remap[p[1]];
+        p[2] = remap[p[2]];
     }
 }
 
@@ -494,8 +485,7 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
 
     // set colorscale and lightscale before mipmap
     comp = GL_GrayScaleTexture(data, width, height, type, flags);
-    GL_LightScaleTexture(data, width, height, type, flags);
-    GL_ColorInvertTexture(data, width, height, type, flags);
+    GL_ColorScaleTexture(data, width, height, type, flags);
 
     if (scaled_width == width && scaled_height == height) {
         // optimized case, do nothing
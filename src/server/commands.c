@@ -514,6 +514,7 @@ static void SV_Kick_f(void)
             match->time = 0;
             match->comment[0] = 0;
             List_Append(&sv_banlist, &match->entry);
+            SV_AddressListChanged();
         }
     }
 
@@ -645,6 +646,22 @@ static void dump_lag(void)
     }
 }
 
+static void dump_budget(void)
+{
+    client_t    *cl;
+
+    Com_Printf(
+        "num name            rate  budget suppressed budgeted deferred\n"
+        "--- --------------- ----- ------ ---------- -------- --------\n");
+
+    FOR_EACH_CLIENT(cl) {
+        Com_Printf("%3i %-15.15s %5i %6u %10u %8u %8u\n",
+                   cl->number, cl->name, cl->rate, cl->frame_budget,
+                   cl->frames_suppressed, cl->frames_budgeted,
+                   cl->ents_deferred);
+    }
+}
+
 static void dump_protocols(void)
 {
     client_t    *cl;
@@ -708,6 +725,7 @@ static void SV_Status_f(void)
         if (Cmd_Argc() > 1) {
             char *w = Cmd_Argv(1);
             switch (*w) {
+            case 'b': dump_budget();    break;
             case 'd': dump_downloads(); break;
             case 'l': dump_lag();       break;
             case 'p': dump_protocols(); break;
@@ -715,7 +733,7 @@ static void SV_Status_f(void)
             case 't': dump_time();      break;
             case 'v': dump_versions();  break;
             default:
-                Com_Printf("Usage: %s [d|l|p|s|t|v]\n", Cmd_Argv(0));
+                Com_Printf("Usage: %s [b|d|l|p|s|t|v]\n", Cmd_Argv(0));
                 dump_clients();
                 break;
             }
@@ -1137,6 +1155,7 @@ void SV_AddMatch_f(list_t *list)
     match->time = 0;
     memcpy(match->comment, s, len + 1);
     List_Append(list, &match->entry);
+    SV_AddressListChanged();
 }
 
 void SV_DelMatch_f(list_t *list)
@@ -1162,6 +1181,7 @@ void SV_DelMatch_f(list_t *list)
             Z_Free(match);
         }
         List_Init(list);
+        SV_AddressListChanged();
         return;
     }
 
@@ -1186,6 +1206,7 @@ void SV_DelMatch_f(list_t *list)
 remove:
             List_Remove(&match->entry);
             Z_Free(match);
+            SV_AddressListChanged();
             return;
         }
     }
@@ -1771,6 +1792,7 @@ static const cmdreg_t c_server[] = {
     { "dumpents", SV_DumpEnts_f },
     { "setmaster", SV_SetMaster_f },
     { "listmasters", SV_ListMasters_f },
+    { "msgstats", SV_MessageStats_f },
     { "killserver", SV_KillServer_f },
     { "sv", SV_ServerCommand_f },
     { "pickclient", SV_PickClient_f },
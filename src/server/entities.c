@@ -125,6 +125,236 @@ static bool SV_TruncPacketEntities(client_t *client, const client_frame_t *from,
     return ret;
 }
 
+/*
+=============
+SV_WriteDeltaEntity
+
+Most clients see the same entities delta compressed from the same old states,
+so remember the last encoding of each entity and copy it when states match.
+=============
+*/
+static void SV_WriteDeltaEntity(const entity_packed_t *from,
+                                const entity_packed_t *to,
+                                msgEsFlags_t          flags)
+{
+    delta_cache_t *d = &svs.delta_cache[to->number & (SV_DELTA_CACHE_SIZE - 1)];
+    unsigned start;
+
+    if (d->to.number == to->number && d->flags == flags &&
+        !memcmp(&d->to, to, sizeof(*to)) &&
+        !memcmp(&d->from, from, sizeof(*from))) {
+        MSG_WriteData(d->data, d->len);
+        return;
+    }
+
+    start = msg_write.cursize;
+    MSG_WriteDeltaEntity(from, to, flags);
+    if (msg_write.overflowed)
+        return;
+
+    d->from = *from;
+    d->to = *to;
+    d->flags = flags;
+    d->len = msg_write.cursize - start;
+    memcpy(d->data, msg_write.data + start, d->len);
+}
+
+static const entity_packed_t *get_baseline(const client_t *client, int number)
+{
+    const entity_packed_t *base = client->baselines[number >> SV_BASELINES_SHIFT];
+
+    if (base)
+        return base + (number & SV_BASELINES_MASK);
+
+    return &nullEntityState;
+}
+
+// true if only movement and animation changed, which can be safely skipped
+// for a frame, since the following delta will catch up
+static bool can_defer_entity(const entity_packed_t *from, const entity_packed_t *to)
+{
+    entity_packed_t tmp;
+
+    if (to->event)
+        return false;
+
+    tmp = *to;
+    VectorCopy(from->origin, tmp.origin);
+    VectorCopy(from->old_origin, tmp.old_origin);
+    VectorCopy(from->angles, tmp.angles);
+    tmp.frame = from->frame;
+
+    return !memcmp(&tmp, from, sizeof(tmp));
+}
+
+typedef struct {
+    int     oldindex;
+    int     newindex;
+    int     cost;
+    float   score;
+} entbudget_t;
+
+static int entbudgetcmp(const void *p1, const void *p2)
+{
+    const entbudget_t *a = p1;
+    const entbudget_t *b = p2;
+
+    if (a->score > b->score)
+        return 1;
+    if (a->score < b->score)
+        return -1;
+    return a->newindex - b->newindex;
+}
+
+static float entity_score(const client_t *client, const client_frame_t *frame,
+                          const entity_packed_t *from, const entity_packed_t *to)
+{
+    vec3_t org, dir, move, angles, forward;
+    float score;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        org[i] = frame->ps.pmove.origin[i];
+        dir[i] = to->origin[i] - org[i];
+        move[i] = to->origin[i] - from->origin[i];
+        angles[i] = SHORT2ANGLE(frame->ps.viewangles[i]);
+    }
+
+    // how far the client view of this entity is from the truth
+    score = VectorLength(move) * 0.125f + 8;
+    for (i = 0; i < 3; i++)
+        score += abs(to->angles[i] - from->angles[i]) * (360.0f / 65536) * 0.25f;
+    if (to->frame != from->frame)
+        score += 8;
+
+    // closer entities matter more
+    score /= VectorLength(dir) * 0.125f + 64;
+
+    // so do entities in front of the viewer
+    AngleVectors(angles, forward, NULL, NULL);
+    if (DotProduct(dir, forward) > 0)
+        score *= 2;
+
+    // and other players
+    if (to->number <= client->maxclients)
+        score *= 4;
+
+    return score;
+}
+
+/*
+=============
+SV_BudgetPacketEntities
+
+Estimates size of packetentities and if the frame doesn't fit into bandwidth
+budget, defers the least important delta updates by keeping old entity states
+in the frame. Deferred entities are picked by distance to the viewer, whether
+they are in front of the viewer and how far their state has moved since the
+last update, so stale entities get their turn eventually.
+=============
+*/
+static void SV_BudgetPacketEntities(client_t *client, const client_frame_t *from,
+                                    client_frame_t *to, int clientEntityNum)
+{
+    static entbudget_t  list[MAX_PACKET_ENTITIES];
+    entity_packed_t *newent;
+    const entity_packed_t *oldent;
+    int i, oldnum, newnum, oldindex, newindex, count, cost, total, budget;
+    unsigned start = msg_write.cursize;
+    msgEsFlags_t flags;
+
+    budget = client->frame_budget - msg_write.cursize - client->msg_unreliable_bytes;
+
+    total = count = 0;
+    newindex = oldindex = 0;
+    oldent = newent = NULL;
+    while (newindex < to->num_entities || oldindex < from->num_entities) {
+        if (msg_write.cursize + MAX_PACKETENTITY_BYTES > msg_write.maxsize)
+            return;
+
+        if (newindex >= to->num_entities) {
+            newnum = MAX_EDICTS;
+        } else {
+            i = (to->first_entity + newindex) & (client->num_entities - 1);
+            newent = &client->entities[i];
+            newnum = newent->number;
+        }
+
+        if (oldindex >= from->num_entities) {
+            oldnum = MAX_EDICTS;
+        } else {
+            i = (from->first_entity + oldindex) & (client->num_entities - 1);
+            oldent = &client->entities[i];
+            oldnum = oldent->number;
+        }
+
+        if (newnum == oldnum) {
+            if (newnum != clientEntityNum) {
+                // encode the delta just to measure it, this also primes delta
+                // cache for the real thing
+                flags = client->esFlags;
+                if (newnum <= client->maxclients)
+                    flags |= MSG_ES_NEWENTITY;
+                SV_WriteDeltaEntity(oldent, newent, flags);
+                cost = msg_write.cursize - start;
+                msg_write.cursize = start;
+
+                if (cost) {
+                    total += cost;
+                    // sv_max_packet_entities may exceed MAX_PACKET_ENTITIES
+                    if (count < q_countof(list) && can_defer_entity(oldent, newent)) {
+                        list[count].oldindex = oldindex;
+                        list[count].newindex = newindex;
+                        list[count].cost = cost;
+                        list[count].score = entity_score(client, to, oldent, newent);
+                        count++;
+                    }
+                }
+            }
+            oldindex++;
+            newindex++;
+            continue;
+        }
+
+        if (newnum < oldnum) {
+            // new entities are always sent
+            if (newnum != clientEntityNum) {
+                flags = client->esFlags | MSG_ES_FORCE | MSG_ES_NEWENTITY;
+                SV_WriteDeltaEntity(get_baseline(client, newnum), newent, flags);
+                total += msg_write.cursize - start;
+                msg_write.cursize = start;
+            }
+            newindex++;
+            continue;
+        }
+
+        if (newnum > oldnum) {
+            // so are removals, at most 4 bytes each
+            total += 4;
+            oldindex++;
+            continue;
+        }
+    }
+
+    if (total <= budget)
+        return;
+
+    qsort(list, count, sizeof(list[0]), entbudgetcmp);
+
+    for (i = 0; i < count && total > budget; i++) {
+        newent = &client->entities[(to->first_entity + list[i].newindex) & (client->num_entities - 1)];
+        oldent = &client->entities[(from->first_entity + list[i].oldindex) & (client->num_entities - 1)];
+        *newent = *oldent;
+        total -= list[i].cost;
+    }
+
+    SV_DPrintf(1, "Deferred %d of %d entities in frame %d for %s\n",
+               i, count, client->framenum, client->name);
+
+    client->frames_budgeted++;
+    client->ents_deferred += i;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -149,6 +379,9 @@ static bool SV_EmitPacketEntities(client_t *client, const client_frame_t *from,
     else
         from_num_entities = from->num_entities;
 
+    if (from && client->frame_budget)
+        SV_BudgetPacketEntities(client, from, to, clientEntityNum);
+
     newindex = 0;
     oldindex = 0;
     oldent = newent = NULL;
@@ -189,7 +422,7 @@ static bool SV_EmitPacketEntities(client_t *client, const client_frame_t *from,
                 VectorCopy(oldent->origin, newent->origin);
                 VectorCopy(oldent->angles, newent->angles);
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             oldindex++;
             newindex++;
             continue;
@@ -198,18 +431,13 @@ static bool SV_EmitPacketEntities(client_t *client, const client_frame_t *from,
         if (newnum < oldnum) {
             // this is a new entity, send it from the baseline
             flags = client->esFlags | MSG_ES_FORCE | MSG_ES_NEWENTITY;
-            oldent = client->baselines[newnum >> SV_BASELINES_SHIFT];
-            if (oldent) {
-                oldent += (newnum & SV_BASELINES_MASK);
-            } else {
-                oldent = &nullEntityState;
-            }
+            oldent = get_baseline(client, newnum);
             if (newnum == clientEntityNum) {
                 flags |= MSG_ES_FIRSTPERSON;
                 VectorCopy(oldent->origin, newent->origin);
                 VectorCopy(oldent->angles, newent->angles);
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             newindex++;
             continue;
         }
@@ -527,6 +755,94 @@ static int entnumcmp(const void *p1, const void *p2)
     return a->s.number - b->s.number;
 }
 
+#if USE_MVD_CLIENT
+/*
+Spectators on a relay mostly chase the same few players. Entity lists built
+for them only differ by view origin and client settings, so remember lists
+built this frame and copy them instead of scanning all entities again.
+*/
+#define FRAME_CACHE_SIZE    8
+
+#define FC_NOGIBS           BIT(0)
+#define FC_NOFLARES         BIT(1)
+#define FC_NOFOOTSTEPS      BIT(2)
+#define FC_OPTIMIZE         BIT(3)
+#define FC_CLIENTNUM_FIX    BIT(4)
+#define FC_FRAMEDIV_SHIFT   8
+
+typedef struct {
+    unsigned            framenum;
+    const cm_t          *cm;
+    const game_export_t *ge;
+    const cs_remap_t    *csr;
+    int                 spawncount;
+    vec3_t              org;
+    int                 clientNum;
+    int                 flags;
+    int                 max_packet_entities;
+    int                 num_entities;   // -1 if not yet built
+    entity_packed_t     entities[MAX_PACKET_ENTITIES];
+} frame_cache_t;
+
+static frame_cache_t    frame_cache[FRAME_CACHE_SIZE];
+
+static frame_cache_t *find_frame_cache(const client_t *client, const vec3_t org,
+                                       int clientNum, int flags, int max_packet_entities)
+{
+    frame_cache_t *fc, *free = NULL;
+    int i;
+
+    for (i = 0, fc = frame_cache; i < FRAME_CACHE_SIZE; i++, fc++) {
+        if (fc->framenum != com_framenum) {
+            if (!free)
+                free = fc;
+            continue;
+        }
+        if (fc->cm == client->cm && fc->ge == client->ge && fc->csr == client->csr &&
+            fc->spawncount == client->spawncount && VectorCompare(fc->org, org) &&
+            fc->clientNum == clientNum && fc->flags == flags &&
+            fc->max_packet_entities == max_packet_entities)
+            return fc;
+    }
+
+    if (!free)
+        return NULL;
+
+    free->framenum = com_framenum;
+    free->cm = client->cm;
+    free->ge = client->ge;
+    free->csr = client->csr;
+    free->spawncount = client->spawncount;
+    VectorCopy(org, free->org);
+    free->clientNum = clientNum;
+    free->flags = flags;
+    free->max_packet_entities = max_packet_entities;
+    free->num_entities = -1;
+    return free;
+}
+
+static int frame_cache_flags(const client_t *client, bool need_clientnum_fix)
+{
+    int flags = 0;
+
+    if (client->settings[CLS_NOGIBS])
+        flags |= FC_NOGIBS;
+    if (client->settings[CLS_NOFLARES])
+        flags |= FC_NOFLARES;
+    if (client->settings[CLS_NOFOOTSTEPS])
+        flags |= FC_NOFOOTSTEPS;
+    if (Q2PRO_OPTIMIZE(client))
+        flags |= FC_OPTIMIZE;
+    if (need_clientnum_fix)
+        flags |= FC_CLIENTNUM_FIX;
+#if USE_FPS
+    flags |= client->framediv << FC_FRAMEDIV_SHIFT;
+#endif
+
+    return flags;
+}
+#endif
+
 /*
 =============
 SV_BuildClientFrame
@@ -554,6 +870,9 @@ void SV_BuildClientFrame(client_t *client)
     qboolean (*visible)(edict_t *, edict_t *) = NULL;
     qboolean (*customize)(edict_t *, edict_t *, customize_entity_t *) = NULL;
     customize_entity_t temp;
+#if USE_MVD_CLIENT
+    frame_cache_t   *fc = NULL;
+#endif
 
     clent = client->edict;
     if (!clent->client)
@@ -616,13 +935,32 @@ void SV_BuildClientFrame(client_t *client)
         customize = gex->CustomizeEntityToClient;
     }
 
-    CM_FatPVS(client->cm, &clientpvs, org);
-    BSP_ClusterVis(client->cm->cache, &clientphs, clientcluster, DVIS_PHS);
-
     // build up the list of visible entities
     frame->num_entities = 0;
     frame->first_entity = client->next_entity;
 
+#if USE_MVD_CLIENT
+    // spectators are not game entities and can't own anything
+    if (sv.state == ss_broadcast && !visible && !customize &&
+        max_packet_entities <= MAX_PACKET_ENTITIES) {
+        fc = find_frame_cache(client, org, frame->clientNum,
+                              frame_cache_flags(client, need_clientnum_fix),
+                              max_packet_entities);
+        if (fc && fc->num_entities >= 0) {
+            for (i = 0; i < fc->num_entities; i++) {
+                state = &client->entities[client->next_entity & (client->num_entities - 1)];
+                *state = fc->entities[i];
+                client->next_entity++;
+            }
+            frame->num_entities = fc->num_entities;
+            goto done;
+        }
+    }
+#endif
+
+    CM_FatPVS(client->cm, &clientpvs, org);
+    BSP_ClusterVis(client->cm->cache, &clientphs, clientcluster, DVIS_PHS);
+
     num_edicts = 0;
     for (e = 1; e < client->ge->num_edicts; e++) {
         ent = EDICT_NUM2(client->ge, e);
@@ -762,6 +1100,15 @@ void SV_BuildClientFrame(client_t *client)
         client->next_entity++;
     }
 
+#if USE_MVD_CLIENT
+    if (fc) {
+        for (i = 0; i < frame->num_entities; i++)
+            fc->entities[i] = client->entities[(frame->first_entity + i) & (client->num_entities - 1)];
+        fc->num_entities = frame->num_entities;
+    }
+
+done:
+#endif
     if (need_clientnum_fix)
         frame->clientNum = client->infonum;
 }
@@ -34,6 +34,7 @@ void SV_ClientReset(client_t *client)
     client->frames_nodelta = 0;
     client->send_delta = 0;
     client->suppress_count = 0;
+    client->frame_budget = 0;
     client->next_entity = 0;
     memset(&client->lastcmd, 0, sizeof(client->lastcmd));
 }
@@ -449,6 +450,7 @@ void SV_InitGame(unsigned mvd_spawn)
 
     svs.maxclients = sv_maxclients->integer;
     svs.client_pool = SV_Mallocz(sizeof(svs.client_pool[0]) * svs.maxclients);
+    svs.delta_cache = SV_Mallocz(sizeof(svs.delta_cache[0]) * SV_DELTA_CACHE_SIZE);
 
 #if USE_ZLIB
     svs.z.zalloc = SV_zalloc;
@@ -457,6 +459,7 @@ void SV_InitGame(unsigned mvd_spawn)
              -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) == Z_OK);
     svs.z_buffer_size = ZPACKET_HEADER + deflateBound(&svs.z, MAX_MSGLEN);
     svs.z_buffer = SV_Malloc(svs.z_buffer_size);
+    svs.z_cache = SV_Mallocz(sizeof(svs.z_cache[0]) * SV_ZCACHE_SIZE);
 #endif
 
     svs.csr = cs_remap_old;
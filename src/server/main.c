@@ -41,6 +41,7 @@ cvar_t  *sv_timescale_kick;
 cvar_t  *sv_allow_nodelta;
 #if USE_FPS
 cvar_t  *sv_fps;
+cvar_t  *sv_max_updaterate;
 #endif
 
 cvar_t  *sv_timeout;            // seconds without any message
@@ -80,6 +81,7 @@ cvar_t  *sv_max_download_size;
 cvar_t  *sv_max_packet_entities;
 cvar_t  *sv_trunc_packet_entities;
 cvar_t  *sv_prioritize_entities;
+cvar_t  *sv_rate_budget;
 
 cvar_t  *sv_strafejump_hack;
 cvar_t  *sv_waterjump_hack;
@@ -100,6 +102,7 @@ cvar_t  *sv_uptime;
 cvar_t  *sv_auth_limit;
 cvar_t  *sv_rcon_limit;
 cvar_t  *sv_namechange_limit;
+cvar_t  *sv_packet_limit;
 
 cvar_t  *sv_allow_unconnected_cmds;
 
@@ -373,10 +376,294 @@ void SV_RateInit(ratelimit_t *r, const char *s)
     r->cost = rate2credits(rate);
 }
 
+/*
+==============================================================================
+
+PER ADDRESS RATE LIMITING
+
+Token buckets live in a fixed size lossy table, indexed by two independent
+hashes of source address, count-min sketch style. Address is limited only if
+both of its buckets are exhausted, so that collisions with abusive addresses
+rarely affect legitimate ones. Lookups are O(1) and memory use doesn't depend
+on number of sources, which is important under spoofed floods.
+
+==============================================================================
+*/
+
+#define ADDR_LIMIT_ROWS     2
+#define ADDR_LIMIT_SIZE     4096    // per row, must be power of two
+
+typedef struct {
+    unsigned    time;
+    unsigned    credit;
+} addrbucket_t;
+
+static addrbucket_t addr_buckets[ADDR_LIMIT_ROWS][ADDR_LIMIT_SIZE];
+static uint64_t     addr_seed;
+
+// hashes IPv6 addresses by /64 prefix, ignores port
+static uint64_t hash_address(const netadr_t *addr, uint64_t seed)
+{
+    uint64_t h = seed ^ addr->type;
+
+    if (addr->type == NA_IP6)
+        h ^= addr->ip.u64[0];
+    else
+        h ^= addr->ip.u32[0];
+
+    // splitmix64 finalizer
+    h = (h ^ (h >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    h = (h ^ (h >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return h ^ (h >> 31);
+}
+
+static void recharge_bucket(addrbucket_t *b, const ratelimit_t *r)
+{
+    unsigned delta = svs.realtime - b->time;
+
+    b->time = svs.realtime;
+    if (delta >= r->credit_cap / CREDITS_PER_MSEC)
+        b->credit = r->credit_cap;
+    else
+        b->credit = min(b->credit + delta * CREDITS_PER_MSEC, r->credit_cap);
+}
+
+/*
+===============
+SV_AddressLimited
+
+Returns true if connectionless packets from this address exceed
+`sv_packet_limit'.
+===============
+*/
+bool SV_AddressLimited(const netadr_t *addr)
+{
+    const ratelimit_t *r = &svs.ratelimit_packet;
+    addrbucket_t *b[ADDR_LIMIT_ROWS];
+    uint64_t h;
+    bool limited = true;
+    int i;
+
+    if (!r->cost)
+        return false;
+
+    if (addr->type != NA_IP && addr->type != NA_IP6)
+        return false;
+
+    h = hash_address(addr, addr_seed);
+    for (i = 0; i < ADDR_LIMIT_ROWS; i++, h >>= 32) {
+        b[i] = &addr_buckets[i][h & (ADDR_LIMIT_SIZE - 1)];
+        recharge_bucket(b[i], r);
+        if (b[i]->credit >= r->cost)
+            limited = false;
+    }
+
+    if (limited)
+        return true;
+
+    for (i = 0; i < ADDR_LIMIT_ROWS; i++)
+        b[i]->credit = b[i]->credit > r->cost ? b[i]->credit - r->cost : 0;
+
+    return false;
+}
+
+static void reset_address_limits(void)
+{
+    int i, j;
+
+    addr_seed = ((uint64_t)Q_rand() << 32) | Q_rand();
+
+    for (i = 0; i < ADDR_LIMIT_ROWS; i++) {
+        for (j = 0; j < ADDR_LIMIT_SIZE; j++) {
+            addr_buckets[i][j].time = svs.realtime;
+            addr_buckets[i][j].credit = svs.ratelimit_packet.credit_cap;
+        }
+    }
+}
+
+/*
+==============================================================================
+
+ADDRESS LISTS
+
+Long address lists get a hash index, so that matching costs one lookup per
+distinct mask instead of a comparison per entry. Indexes are rebuilt lazily
+after any list changes. First matching entry in list order is still returned,
+so hit counters and ban comments behave the same as with linear search.
+
+==============================================================================
+*/
+
+#define ADDR_INDEX_MIN      16      // shorter lists are scanned linearly
+#define ADDR_INDEX_MASKS    16      // max distinct masks per index
+#define ADDR_INDEX_LISTS    8
+
+typedef struct {
+    addrmatch_t *match;
+    unsigned    order;
+} addrslot_t;
+
+typedef struct {
+    const list_t    *list;
+    unsigned        generation;
+    bool            valid;
+    int             nummasks;
+    netadr_t        masks[ADDR_INDEX_MASKS];
+    unsigned        size;
+    addrslot_t      *slots;
+} addrindex_t;
+
+static addrindex_t  addr_indexes[ADDR_INDEX_LISTS];
+static unsigned     addr_generation = 1;
+
+static uint64_t hash_masked(const netadr_t *addr, const netadr_t *mask)
+{
+    netadr_t tmp;
+
+    tmp.type = addr->type;
+    if (addr->type == NA_IP6) {
+        tmp.ip.u64[0] = addr->ip.u64[0] & mask->ip.u64[0];
+        tmp.ip.u64[1] = addr->ip.u64[1] & mask->ip.u64[1];
+        return hash_address(&tmp, tmp.ip.u64[1]);
+    }
+
+    tmp.ip.u32[0] = addr->ip.u32[0] & mask->ip.u32[0];
+    return hash_address(&tmp, 0);
+}
+
+static bool equal_masks(const netadr_t *a, const netadr_t *b)
+{
+    if (a->type != b->type)
+        return false;
+    if (a->type == NA_IP6)
+        return a->ip.u64[0] == b->ip.u64[0] && a->ip.u64[1] == b->ip.u64[1];
+    return a->ip.u32[0] == b->ip.u32[0];
+}
+
+/*
+===============
+SV_AddressListChanged
+
+Must be called after adding or removing entries of any address list.
+===============
+*/
+void SV_AddressListChanged(void)
+{
+    addr_generation++;
+}
+
+static void build_address_index(addrindex_t *index)
+{
+    addrmatch_t *match;
+    addrslot_t *slot;
+    unsigned i, j, count = 0;
+
+    index->generation = addr_generation;
+    index->valid = false;
+    index->nummasks = 0;
+
+    LIST_FOR_EACH(addrmatch_t, match, index->list, entry) {
+        for (i = 0; i < index->nummasks; i++)
+            if (equal_masks(&match->mask, &index->masks[i]))
+                break;
+        if (i == index->nummasks) {
+            if (i == ADDR_INDEX_MASKS)
+                return;
+            index->masks[index->nummasks++] = match->mask;
+        }
+        count++;
+    }
+
+    if (count < ADDR_INDEX_MIN)
+        return;
+
+    if (index->size < count * 2) {
+        Z_Free(index->slots);
+        index->size = Q_npot32(count * 2);
+        index->slots = Z_Malloc(sizeof(index->slots[0]) * index->size);
+    }
+    memset(index->slots, 0, sizeof(index->slots[0]) * index->size);
+
+    i = 0;
+    LIST_FOR_EACH(addrmatch_t, match, index->list, entry) {
+        j = hash_masked(&match->addr, &match->mask) & (index->size - 1);
+        for (slot = &index->slots[j]; slot->match; slot = &index->slots[j])
+            j = (j + 1) & (index->size - 1);
+        slot->match = match;
+        slot->order = i++;
+    }
+
+    index->valid = true;
+}
+
+static addrindex_t *get_address_index(const list_t *list)
+{
+    addrindex_t *index, *free = NULL;
+    int i;
+
+    for (i = 0, index = addr_indexes; i < ADDR_INDEX_LISTS; i++, index++) {
+        if (index->list == list)
+            break;
+        if (!index->list && !free)
+            free = index;
+    }
+
+    if (i == ADDR_INDEX_LISTS) {
+        if (!free)
+            return NULL;
+        index = free;
+        index->list = list;
+        index->generation = 0;
+    }
+
+    if (index->generation != addr_generation)
+        build_address_index(index);
+
+    return index->valid ? index : NULL;
+}
+
+static addrmatch_t *match_address_index(const addrindex_t *index, const netadr_t *addr)
+{
+    const addrslot_t *slot, *best = NULL;
+    unsigned i, j;
+
+    for (i = 0; i < index->nummasks; i++) {
+        const netadr_t *mask = &index->masks[i];
+
+        if (mask->type != addr->type)
+            continue;
+
+        j = hash_masked(addr, mask) & (index->size - 1);
+        for (slot = &index->slots[j]; slot->match; slot = &index->slots[j]) {
+            if ((!best || slot->order < best->order) &&
+                equal_masks(&slot->match->mask, mask) &&
+                NET_IsEqualBaseAdrMask(addr, &slot->match->addr, mask))
+                best = slot;
+            j = (j + 1) & (index->size - 1);
+        }
+    }
+
+    return best ? best->match : NULL;
+}
+
 addrmatch_t *SV_MatchAddress(const list_t *list, const netadr_t *addr)
 {
+    const addrindex_t *index;
     addrmatch_t *match;
 
+    if (LIST_EMPTY(list))
+        return NULL;
+
+    index = get_address_index(list);
+    if (index) {
+        match = match_address_index(index, addr);
+        if (match) {
+            match->hits++;
+            match->time = time(NULL);
+        }
+        return match;
+    }
+
     LIST_FOR_EACH(addrmatch_t, match, list, entry) {
         if (NET_IsEqualBaseAdrMask(addr, &match->addr, &match->mask)) {
             match->hits++;
@@ -1304,6 +1591,12 @@ static void SV_ConnectionlessPacket(void)
         return;
     }
 
+    if (SV_AddressLimited(&net_from)) {
+        Com_DPrintf("ignored rate limited connectionless packet from %s\n",
+                    NET_AdrToString(&net_from));
+        return;
+    }
+
     MSG_BeginReading();
     MSG_ReadLong();        // skip the -1 marker
 
@@ -2105,11 +2398,19 @@ static void sv_rcon_limit_changed(cvar_t *self)
     SV_RateInit(&svs.ratelimit_rcon, self->string);
 }
 
+static void sv_packet_limit_changed(cvar_t *self)
+{
+    SV_RateInit(&svs.ratelimit_packet, self->string);
+    reset_address_limits();
+}
+
 static void init_rate_limits(void)
 {
     SV_RateInit(&svs.ratelimit_status, sv_status_limit->string);
     SV_RateInit(&svs.ratelimit_auth, sv_auth_limit->string);
     SV_RateInit(&svs.ratelimit_rcon, sv_rcon_limit->string);
+    SV_RateInit(&svs.ratelimit_packet, sv_packet_limit->string);
+    reset_address_limits();
 }
 
 static void sv_rate_changed(cvar_t *self)
@@ -2213,6 +2514,7 @@ void SV_Init(void)
     sv_allow_nodelta = Cvar_Get("sv_allow_nodelta", "1", 0);
 #if USE_FPS
     sv_fps = Cvar_Get("sv_fps", "10", CVAR_LATCH);
+    sv_max_updaterate = Cvar_Get("sv_max_updaterate", "0", CVAR_LATCH);
 #endif
     sv_force_reconnect = Cvar_Get("sv_force_reconnect", "", CVAR_LATCH);
     sv_show_name_changes = Cvar_Get("sv_show_name_changes", "0", 0);
@@ -2242,6 +2544,7 @@ void SV_Init(void)
     sv_max_packet_entities = Cvar_Get("sv_max_packet_entities", "0", 0);
     sv_trunc_packet_entities = Cvar_Get("sv_trunc_packet_entities", "1", 0);
     sv_prioritize_entities = Cvar_Get("sv_prioritize_entities", "0", 0);
+    sv_rate_budget = Cvar_Get("sv_rate_budget", "0", 0);
 
     sv_strafejump_hack = Cvar_Get("sv_strafejump_hack", "1", CVAR_LATCH);
     sv_waterjump_hack = Cvar_Get("sv_waterjump_hack", "1", CVAR_LATCH);
@@ -2277,6 +2580,9 @@ void SV_Init(void)
     sv_namechange_limit = Cvar_Get("sv_namechange_limit", "5/min", 0);
     sv_namechange_limit->changed = sv_namechange_limit_changed;
 
+    sv_packet_limit = Cvar_Get("sv_packet_limit", "20*40", 0);
+    sv_packet_limit->changed = sv_packet_limit_changed;
+
     sv_allow_unconnected_cmds = Cvar_Get("sv_allow_unconnected_cmds", "0", 0);
 
     sv_lrcon_password = Cvar_Get("lrcon_password", "", CVAR_PRIVATE);
@@ -2397,10 +2703,13 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     // free server static data
     Z_Free(svs.client_pool);
+    Z_Free(svs.delta_cache);
 #if USE_ZLIB
     deflateEnd(&svs.z);
     Z_Free(svs.z_buffer);
+    SV_FreeCompressCache();
 #endif
+    SV_FreeMessageBlocks();
     memset(&svs, 0, sizeof(svs));
 
     // reset rate limits
@@ -2436,6 +2436,8 @@ static void MVD_Seek_f(void)
         ent->s.event = EV_OTHER_TELEPORT;
     }
 
+    mvd->unlinked = false;
+
     MVD_UpdateClients(mvd);
 
     // wait one frame to give entity events a chance to be communicated back to
@@ -141,6 +141,7 @@ typedef struct mvd_s {
     qhandle_t   demorecording;
     char        *demoname;
     bool        demoseeking;
+    bool        unlinked;       // world links are stale, no spectators attached
     int         last_snapshot;
     mvd_snap_t  **snapshots;
     int         numsnapshots;
@@ -247,3 +248,4 @@ void MVD_UpdateConfigstring(mvd_t *mvd, int index);
 void MVD_WriteStringList(mvd_client_t *client, mvd_cs_t *cs);
 void MVD_SetPlayerNames(mvd_t *mvd);
 void MVD_LinkEdict(mvd_t *mvd, edict_t *ent);
+void MVD_RelinkEdicts(mvd_t *mvd);
@@ -807,6 +807,8 @@ void MVD_SwitchChannel(mvd_client_t *client, mvd_t *mvd)
 {
     client_t *cl = client->cl;
 
+    MVD_RelinkEdicts(mvd);
+
     List_Remove(&client->entry);
     List_SeqAdd(&mvd->clients, &client->entry);
     client->mvd = mvd;
@@ -1750,6 +1752,29 @@ void MVD_LinkEdict(mvd_t *mvd, edict_t *ent)
     SV_LinkEdict(&mvd->cm, ent);
 }
 
+// Channels without UDP spectators skip entity linking while parsing, so that
+// a relay hosting many channels only pays for the ones being watched. Bring
+// the world back in sync before the first spectator attaches.
+void MVD_RelinkEdicts(mvd_t *mvd)
+{
+    int i;
+
+    if (!mvd->unlinked)
+        return;
+
+    mvd->unlinked = false;
+
+    if (!mvd->cm.cache)
+        return;
+
+    for (i = 1; i < mvd->csr->max_edicts; i++) {
+        edict_t *ent = &mvd->edicts[i];
+
+        if (ent->svflags & SVF_MVD_SEEN)
+            MVD_LinkEdict(mvd, ent);
+    }
+}
+
 void MVD_RemoveClient(client_t *client)
 {
     int index = client - svs.client_pool;
@@ -1894,6 +1919,7 @@ static qboolean MVD_GameClientConnect(edict_t *ent, char *userinfo)
     if (!mvd || !MVD_ClientCompatible(client->cl, mvd)) {
         mvd = &mvd_waitingRoom;
     }
+    MVD_RelinkEdicts(mvd);
     List_SeqAdd(&mvd->clients, &client->entry);
     client->mvd = mvd;
 
@@ -532,6 +532,7 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
         if (LIST_EMPTY(&cl->msg_free_list)) {
             Com_DWPrintf("%s to %s: out of message slots\n",
                          __func__, cl->name);
+            svs.msg.failures++;
             continue;
         }
 
@@ -632,7 +633,7 @@ static void MVD_PlayerToEntityStates(mvd_t *mvd)
 
         Com_PlayerToEntityState(&player->ps, &edict->s);
 
-        if (!mvd->demoseeking) {
+        if (!mvd->demoseeking && !mvd->unlinked) {
             MVD_LinkEdict(mvd, edict);
         }
     }
@@ -682,7 +683,7 @@ static void MVD_ParsePacketEntities(mvd_t *mvd)
         MSG_ParseDeltaEntity(&ent->s, &ent->x, number, bits, mvd->esFlags);
 
         // lazily relink even if removed
-        if ((bits & RELINK_MASK) && !mvd->demoseeking) {
+        if ((bits & RELINK_MASK) && !mvd->demoseeking && !mvd->unlinked) {
             MVD_LinkEdict(mvd, ent);
         }
 
@@ -784,6 +785,11 @@ static void MVD_ParseFrame(mvd_t *mvd)
     if (!mvd->demoseeking)
         CM_SetPortalStates(&mvd->cm, data, length);
 
+    // nobody is watching this channel over UDP, don't maintain world links
+    // until somebody attaches (see MVD_RelinkEdicts)
+    if (LIST_EMPTY(&mvd->clients))
+        mvd->unlinked = true;
+
     SHOWNET(2, "%3u:playerinfo\n", msg_read.readcount);
     MVD_ParsePacketPlayers(mvd);
     SHOWNET(2, "%3u:packetentities\n", msg_read.readcount);
@@ -57,9 +57,11 @@ bandwidth estimation and should not be sent another packet
 */
 static bool SV_RateDrop(client_t *client)
 {
-    size_t  total;
+    size_t  total, budget;
     int     i;
 
+    client->frame_budget = 0;
+
     // never drop over the loopback
     if (!client->rate) {
         return false;
@@ -79,10 +81,28 @@ static bool SV_RateDrop(client_t *client)
                    client->framenum, client->name, total);
         client->frameflags |= FF_SUPPRESSED;
         client->suppress_count++;
+        client->frames_suppressed++;
         client->message_size[client->framenum % RATE_MESSAGES] = 0;
         return true;
     }
 
+    // limit this frame to what is left of the rate window, but at most to
+    // twice the fair share, so that bursts get trimmed by deferring low
+    // priority entity updates instead of dropping following frames
+    if (sv_rate_budget->integer) {
+        budget = client->rate - total;
+#if USE_FPS
+        budget += client->message_size[client->framenum % RATE_MESSAGES] * sv.frametime.div / client->framediv;
+#else
+        budget += client->message_size[client->framenum % RATE_MESSAGES];
+#endif
+        budget = min(budget, client->rate * 2 / RATE_MESSAGES);
+#if USE_FPS
+        budget = budget * client->framediv / sv.frametime.div;
+#endif
+        client->frame_budget = max(budget, 1);
+    }
+
     return false;
 }
 
@@ -335,14 +355,39 @@ static bool can_auto_compress(const client_t *client)
     return true;
 }
 
-static int compress_message(const client_t *client)
+static uint32_t hash_message(void)
 {
-    int     ret, len;
-    byte    *hdr;
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < msg_write.cursize; i++)
+        hash = (hash ^ msg_write.data[i]) * 16777619u;
+
+    return hash;
+}
+
+/*
+Same data is often compressed over and over again: layouts and scores are
+sent to many clients in a row, and every connecting client gets the same
+gamestate chunks. Remember recently compressed messages and reuse them.
+*/
+static int compress_message(const client_t *client, const byte **data)
+{
+    int         ret, len;
+    byte        *hdr;
+    uint32_t    hash;
+    zcache_t    *z;
 
     if (!client->has_zlib)
         return 0;
 
+    hash = hash_message();
+    z = &svs.z_cache[hash & (SV_ZCACHE_SIZE - 1)];
+    if (z->len && z->hash == hash && z->size == msg_write.cursize &&
+        !memcmp(z->data, msg_write.data, msg_write.cursize)) {
+        *data = z->data + z->size;
+        return z->len;
+    }
+
     svs.z.next_in = msg_write.data;
     svs.z.avail_in = msg_write.cursize;
     svs.z.next_out = svs.z_buffer + ZPACKET_HEADER;
@@ -365,18 +410,40 @@ static int compress_message(const client_t *client)
     hdr[0] = svc_zpacket;
     WL16(&hdr[1], len);
     WL16(&hdr[3], msg_write.cursize);
+    len += ZPACKET_HEADER;
 
-    return len + ZPACKET_HEADER;
+    // replace cache entry
+    if (z->maxsize < msg_write.cursize + len) {
+        Z_Free(z->data);
+        z->maxsize = msg_write.cursize + len;
+        z->data = SV_Malloc(z->maxsize);
+    }
+    memcpy(z->data, msg_write.data, msg_write.cursize);
+    memcpy(z->data + msg_write.cursize, svs.z_buffer, len);
+    z->hash = hash;
+    z->size = msg_write.cursize;
+    z->len = len;
+
+    *data = svs.z_buffer;
+    return len;
 }
 
-static byte *get_compressed_data(void)
+void SV_FreeCompressCache(void)
 {
-    return svs.z_buffer;
+    int i;
+
+    if (!svs.z_cache)
+        return;
+
+    for (i = 0; i < SV_ZCACHE_SIZE; i++)
+        Z_Free(svs.z_cache[i].data);
+
+    Z_Free(svs.z_cache);
+    svs.z_cache = NULL;
 }
 #else
-#define can_auto_compress(c)    false
-#define compress_message(c)     0
-#define get_compressed_data()   NULL
+#define can_auto_compress(c)        false
+#define compress_message(c, d)      0
 #endif
 
 /*
@@ -390,6 +457,7 @@ unless told otherwise.
 */
 void SV_ClientAddMessage(client_t *client, int flags)
 {
+    const byte *data = NULL;
     int len;
 
     Q_assert(!msg_write.overflowed);
@@ -402,8 +470,8 @@ void SV_ClientAddMessage(client_t *client, int flags)
         flags |= MSG_COMPRESS;
     }
 
-    if ((flags & MSG_COMPRESS) && (len = compress_message(client)) && len < msg_write.cursize) {
-        client->AddMessage(client, get_compressed_data(), len, flags & MSG_RELIABLE);
+    if ((flags & MSG_COMPRESS) && (len = compress_message(client, &data)) && len < msg_write.cursize) {
+        client->AddMessage(client, data, len, flags & MSG_RELIABLE);
         SV_DPrintf(1, "Compressed %sreliable message to %s: %u into %d\n",
                    (flags & MSG_RELIABLE) ? "" : "un", client->name, msg_write.cursize, len);
     } else {
@@ -425,6 +493,118 @@ FRAME UPDATES - COMMON
 ===============================================================================
 */
 
+static msg_block_t *alloc_msg_block(size_t len)
+{
+    msg_block_t *block;
+    int sizeclass = 0;
+
+    while ((1U << (MSG_BLOCK_SHIFT + sizeclass)) < len)
+        sizeclass++;
+    Q_assert(sizeclass < MSG_BLOCK_CLASSES);
+
+    block = svs.msg.free[sizeclass];
+    if (block) {
+        svs.msg.free[sizeclass] = block->next;
+        svs.msg.cached_bytes -= 1U << (MSG_BLOCK_SHIFT + sizeclass);
+        svs.msg.reuses++;
+    } else {
+        block = SV_Malloc(sizeof(*block) + (1U << (MSG_BLOCK_SHIFT + sizeclass)));
+        block->sizeclass = sizeclass;
+        svs.msg.allocs++;
+    }
+
+    block->next = NULL;
+    block->refcount = 1;
+    block->size = len;
+
+    svs.msg.blocks++;
+    svs.msg.bytes += len;
+    svs.msg.peak_bytes = max(svs.msg.peak_bytes, svs.msg.bytes);
+    return block;
+}
+
+static void release_msg_block(msg_block_t *block)
+{
+    unsigned size = 1U << (MSG_BLOCK_SHIFT + block->sizeclass);
+
+    Q_assert(block->refcount > 0);
+    if (--block->refcount)
+        return;
+
+    svs.msg.blocks--;
+    svs.msg.bytes -= block->size;
+
+    // keep some memory around for reuse
+    if (svs.msg.cached_bytes + size > MSG_BLOCK_CACHE) {
+        Z_Free(block);
+        return;
+    }
+
+    block->next = svs.msg.free[block->sizeclass];
+    svs.msg.free[block->sizeclass] = block;
+    svs.msg.cached_bytes += size;
+}
+
+// same multicast message is usually queued for many clients in a row
+static msg_block_t *get_msg_block(const byte *data, size_t len)
+{
+    msg_block_t *block = svs.msg.last;
+
+    if (block && block->size == len && !memcmp(block->data, data, len)) {
+        block->refcount++;
+        svs.msg.shares++;
+        return block;
+    }
+
+    if (block)
+        release_msg_block(block);
+
+    block = alloc_msg_block(len);
+    memcpy(block->data, data, len);
+
+    // hold a reference for sharing with the next client
+    block->refcount++;
+    svs.msg.last = block;
+    return block;
+}
+
+void SV_FreeMessageBlocks(void)
+{
+    msg_block_t *block, *next;
+    int i;
+
+    if (svs.msg.last) {
+        release_msg_block(svs.msg.last);
+        svs.msg.last = NULL;
+    }
+
+    for (i = 0; i < MSG_BLOCK_CLASSES; i++) {
+        for (block = svs.msg.free[i]; block; block = next) {
+            next = block->next;
+            Z_Free(block);
+        }
+        svs.msg.free[i] = NULL;
+    }
+
+    svs.msg.cached_bytes = 0;
+}
+
+void SV_MessageStats_f(void)
+{
+    Com_Printf("Blocks in use: %u (%u bytes, %u peak)\n",
+               svs.msg.blocks, svs.msg.bytes, svs.msg.peak_bytes);
+    Com_Printf("Cached bytes : %u\n", svs.msg.cached_bytes);
+    Com_Printf("Allocations  : %u\n", svs.msg.allocs);
+    Com_Printf("Reused blocks: %u\n", svs.msg.reuses);
+    Com_Printf("Shared blocks: %u\n", svs.msg.shares);
+    Com_Printf("Failures     : %u\n", svs.msg.failures);
+}
+
+static inline const byte *msg_data(const message_packet_t *msg)
+{
+    return msg->cursize > MSG_TRESHOLD ? msg->block->data : msg->data;
+}
+
 static inline void free_msg_packet(client_t *client, message_packet_t *msg)
 {
     List_Remove(&msg->entry);
@@ -432,10 +612,10 @@ static inline void free_msg_packet(client_t *client, message_packet_t *msg)
     if (msg->cursize > MSG_TRESHOLD) {
         Q_assert(msg->cursize <= client->msg_dynamic_bytes);
         client->msg_dynamic_bytes -= msg->cursize;
-        Z_Free(msg);
-    } else {
-        List_Insert(&client->msg_free_list, &msg->entry);
+        release_msg_block(msg->block);
     }
+
+    List_Insert(&client->msg_free_list, &msg->entry);
 }
 
 #define FOR_EACH_MSG_SAFE(list) \
@@ -468,25 +648,28 @@ static void add_msg_packet(client_t *client, const byte *data,
 
     Q_assert(len <= MAX_MSGLEN);
 
+    if (LIST_EMPTY(&client->msg_free_list)) {
+        Com_DWPrintf("%s to %s: out of message slots\n",
+                     __func__, client->name);
+        goto overflowed;
+    }
+
     if (len > MSG_TRESHOLD) {
         if (client->msg_dynamic_bytes > MAX_MSGLEN - len) {
             Com_DWPrintf("%s to %s: out of dynamic memory\n",
                          __func__, client->name);
             goto overflowed;
         }
-        msg = SV_Malloc(sizeof(*msg) + len - MSG_TRESHOLD);
         client->msg_dynamic_bytes += len;
-    } else {
-        if (LIST_EMPTY(&client->msg_free_list)) {
-            Com_DWPrintf("%s to %s: out of message slots\n",
-                         __func__, client->name);
-            goto overflowed;
-        }
-        msg = MSG_FIRST(&client->msg_free_list);
-        List_Remove(&msg->entry);
     }
 
-    memcpy(msg->data, data, len);
+    msg = MSG_FIRST(&client->msg_free_list);
+    List_Remove(&msg->entry);
+
+    if (len > MSG_TRESHOLD)
+        msg->block = get_msg_block(data, len);
+    else
+        memcpy(msg->data, data, len);
     msg->cursize = (uint16_t)len;
 
     if (reliable) {
@@ -499,6 +682,7 @@ static void add_msg_packet(client_t *client, const byte *data,
     return;
 
 overflowed:
+    svs.msg.failures++;
     if (reliable) {
         free_all_messages(client);
         SV_DropClient(client, "reliable queue overflowed");
@@ -579,7 +763,7 @@ static inline void write_msg(client_t *client, message_packet_t *msg, unsigned m
 {
     // if this msg fits, write it
     if (msg_write.cursize + msg->cursize <= maxsize) {
-        MSG_WriteData(msg->data, msg->cursize);
+        MSG_WriteData(msg_data(msg), msg->cursize);
     }
     free_msg_packet(client, msg);
 }
@@ -647,7 +831,7 @@ static void write_reliables_old(client_t *client, unsigned maxsize)
         SV_DPrintf(2, "%s to %s: writing msg %d: %d bytes\n",
                    __func__, client->name, count, msg->cursize);
 
-        SZ_Write(&client->netchan.message, msg->data, msg->cursize);
+        SZ_Write(&client->netchan.message, msg_data(msg), msg->cursize);
         free_msg_packet(client, msg);
         count++;
     }
@@ -657,6 +841,7 @@ static void write_reliables_old(client_t *client, unsigned maxsize)
 static void repack_unreliables(client_t *client, unsigned maxsize)
 {
     message_packet_t *msg, *next;
+    const byte *data;
 
     if (msg_write.cursize + 4 > maxsize) {
         return;
@@ -664,13 +849,14 @@ static void repack_unreliables(client_t *client, unsigned maxsize)
 
     // temp entities first
     FOR_EACH_MSG_SAFE(&client->msg_unreliable_list) {
-        if (msg->cursize == SOUND_PACKET || msg->data[0] != svc_temp_entity) {
+        if (msg->cursize == SOUND_PACKET || msg_data(msg)[0] != svc_temp_entity) {
             continue;
         }
         // ignore some low-priority effects, these checks come from R1Q2
-        if (msg->data[1] == TE_BLOOD || msg->data[1] == TE_SPLASH ||
-            msg->data[1] == TE_GUNSHOT || msg->data[1] == TE_BULLET_SPARKS ||
-            msg->data[1] == TE_SHOTGUN) {
+        data = msg_data(msg);
+        if (data[1] == TE_BLOOD || data[1] == TE_SPLASH ||
+            data[1] == TE_GUNSHOT || data[1] == TE_BULLET_SPARKS ||
+            data[1] == TE_SHOTGUN) {
             continue;
         }
         write_msg(client, msg, maxsize);
@@ -693,7 +879,7 @@ static void repack_unreliables(client_t *client, unsigned maxsize)
 
     // then positioned sounds
     FOR_EACH_MSG_SAFE(&client->msg_unreliable_list) {
-        if (msg->cursize != SOUND_PACKET && msg->data[0] == svc_sound) {
+        if (msg->cursize != SOUND_PACKET && msg_data(msg)[0] == svc_sound) {
             write_msg(client, msg, maxsize);
         }
     }
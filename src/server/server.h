@@ -219,11 +219,26 @@ typedef enum {
 #define MAX_SOUND_PACKET    15
 #define SOUND_PACKET        0       // special value for cursize
 
+// messages larger than MSG_TRESHOLD are stored in refcounted blocks,
+// shared between all clients the same message is queued for
+#define MSG_BLOCK_SHIFT     6
+#define MSG_BLOCK_CLASSES   10      // 64 bytes to MAX_MSGLEN
+#define MSG_BLOCK_CACHE     0x100000
+
+typedef struct msg_block_s {
+    struct msg_block_s  *next;      // on free list
+    int                 refcount;
+    int                 sizeclass;
+    unsigned            size;
+    uint8_t             data[];
+} msg_block_t;
+
 typedef struct {
     list_t              entry;
     uint16_t            cursize;    // zero means sound packet
     union {
         uint8_t         data[MSG_TRESHOLD];
+        msg_block_t     *block;     // if cursize > MSG_TRESHOLD
         struct {
             uint16_t    index;
             uint16_t    sendchan;
@@ -317,6 +332,8 @@ typedef struct client_s {
     unsigned        message_size[RATE_MESSAGES];    // used to rate drop normal packets
     int             suppress_count;                 // number of messages rate suppressed
     unsigned        send_time, send_delta;          // used to rate drop async packets
+    unsigned        frame_budget;                   // bytes for current frame, 0 if unlimited
+    unsigned        frames_suppressed, frames_budgeted, ents_deferred;
 
     // current download
     byte            *download;      // file being downloaded
@@ -462,6 +479,31 @@ typedef struct {
     cm_t            cm;
 } mapcmd_t;
 
+#define SV_DELTA_CACHE_SIZE 1024
+
+// recently encoded entity delta, looked up by entity number. Encoding depends
+// only on from/to states and flags, so it can be reused for any client.
+typedef struct {
+    entity_packed_t from;
+    entity_packed_t to;     // number is 0 if entry is unused
+    msgEsFlags_t    flags;
+    unsigned        len;
+    byte            data[MAX_PACKETENTITY_BYTES];
+} delta_cache_t;
+
+#if USE_ZLIB
+#define SV_ZCACHE_SIZE      128
+
+// recently compressed message, looked up by hash of uncompressed data
+typedef struct {
+    uint32_t    hash;
+    unsigned    size;       // uncompressed size
+    unsigned    len;        // compressed size, 0 if entry is unused
+    unsigned    maxsize;
+    byte        *data;      // uncompressed data followed by compressed
+} zcache_t;
+#endif
+
 typedef struct {
     bool        initialized;        // sv_init has completed
     unsigned    realtime;           // always increasing, no clamping, etc
@@ -470,12 +512,28 @@ typedef struct {
     int         maxclients;
     client_t    *client_pool;       // [maxclients]
 
+    delta_cache_t   *delta_cache;   // [SV_DELTA_CACHE_SIZE]
+
 #if USE_ZLIB
     z_stream        z;  // for compressing messages at once
     byte            *z_buffer;
     unsigned        z_buffer_size;
+    zcache_t        *z_cache;       // [SV_ZCACHE_SIZE]
 #endif
 
+    struct {
+        msg_block_t     *free[MSG_BLOCK_CLASSES];
+        msg_block_t     *last;          // most recently queued message
+        unsigned        cached_bytes;   // on free lists
+        unsigned        blocks;         // in use
+        unsigned        bytes;          // in use
+        unsigned        peak_bytes;
+        unsigned        allocs;
+        unsigned        reuses;
+        unsigned        shares;
+        unsigned        failures;
+    } msg;
+
 #if USE_SAVEGAMES
     int             gamedetecthack;
 #endif
@@ -491,6 +549,7 @@ typedef struct {
     ratelimit_t     ratelimit_status;
     ratelimit_t     ratelimit_auth;
     ratelimit_t     ratelimit_rcon;
+    ratelimit_t     ratelimit_packet;       // per source address
 
     challenge_t     challenges[MAX_CHALLENGES]; // to prevent invalid IPs from connecting
 } server_static_t;
@@ -521,6 +580,7 @@ extern cvar_t       *sv_qwmod;                // atu QW Physics modificator
 extern cvar_t       *sv_enforcetime;
 #if USE_FPS
 extern cvar_t       *sv_fps;
+extern cvar_t       *sv_max_updaterate;
 #endif
 extern cvar_t       *sv_force_reconnect;
 extern cvar_t       *sv_iplimit;
@@ -537,6 +597,7 @@ extern cvar_t       *sv_max_download_size;
 extern cvar_t       *sv_max_packet_entities;
 extern cvar_t       *sv_trunc_packet_entities;
 extern cvar_t       *sv_prioritize_entities;
+extern cvar_t       *sv_rate_budget;
 
 extern cvar_t       *sv_strafejump_hack;
 #if USE_PACKETDUP
@@ -553,6 +614,7 @@ extern cvar_t       *sv_status_limit;
 extern cvar_t       *sv_status_show;
 extern cvar_t       *sv_auth_limit;
 extern cvar_t       *sv_rcon_limit;
+extern cvar_t       *sv_packet_limit;
 extern cvar_t       *sv_uptime;
 
 extern cvar_t       *sv_allow_unconnected_cmds;
@@ -584,7 +646,10 @@ bool SV_RateLimited(ratelimit_t *r);
 void SV_RateRecharge(ratelimit_t *r);
 void SV_RateInit(ratelimit_t *r, const char *s);
 
+bool SV_AddressLimited(const netadr_t *addr);
+
 addrmatch_t *SV_MatchAddress(const list_t *list, const netadr_t *address);
+void SV_AddressListChanged(void);
 
 int SV_CountClients(void);
 
@@ -631,8 +696,13 @@ void SV_BroadcastPrintf(int level, const char *fmt, ...) q_printf(2, 3);
 void SV_ClientCommand(client_t *cl, const char *fmt, ...) q_printf(2, 3);
 void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
+#if USE_ZLIB
+void SV_FreeCompressCache(void);
+#endif
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
+void SV_FreeMessageBlocks(void);
+void SV_MessageStats_f(void);
 
 //
 // sv_mvd.c
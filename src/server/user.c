@@ -99,14 +99,23 @@ static void SV_CreateBaselines(void)
     }
 }
 
-static void maybe_flush_msg(size_t size)
+static size_t   gamestate_chunk;
+
+// find the largest message that still fits into a packet after compression
+static void calc_gamestate_chunk(void)
 {
-    size += msg_write.cursize;
+    gamestate_chunk = sv_client->netchan.maxpacketlen;
 #if USE_ZLIB
     if (sv_client->has_zlib)
-        size = ZPACKET_HEADER + deflateBound(&svs.z, size);
+        while (gamestate_chunk > 0 && ZPACKET_HEADER +
+               deflateBound(&svs.z, gamestate_chunk) > sv_client->netchan.maxpacketlen)
+            gamestate_chunk--;
 #endif
-    if (size > sv_client->netchan.maxpacketlen)
+}
+
+static void maybe_flush_msg(size_t size)
+{
+    if (msg_write.cursize + size > gamestate_chunk)
         SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
 }
 
@@ -473,6 +482,7 @@ void SV_New_f(void)
 
     // send gamestate
     if (sv_client->netchan.type == NETCHAN_OLD) {
+        calc_gamestate_chunk();
         write_configstrings();
         write_baselines();
     } else if (sv_client->version >= PROTOCOL_VERSION_Q2PRO_EXTENDED_LIMITS) {
@@ -1520,6 +1530,17 @@ static void set_client_fps(int value)
 
     framediv = Q_clip(value / BASE_FRAMERATE, 1, MAX_FRAMEDIV);
     framediv = sv.frametime.div / Q_gcd(sv.frametime.div, framediv);
+
+    // server may limit update rate independently of its own frame rate,
+    // skipping frame building and encoding for this client on other frames
+    if (sv_max_updaterate->integer > 0) {
+        while (framediv < sv.frametime.div && sv.framerate / framediv > sv_max_updaterate->integer) {
+            do {
+                framediv++;
+            } while (sv.frametime.div % framediv);
+        }
+    }
+
     framerate = sv.framerate / framediv;
 
     Com_DDPrintf("[%d] client div=%d, server div=%d, rate=%d\n",
@@ -146,4 +146,5 @@ const snddma_driver_t snddma_sdl = {
     .begin_painting = BeginPainting,
     .submit = Submit,
     .activate = Activate,
+    .threaded = true,
 };
@@ -85,6 +85,13 @@ unsigned Sys_Milliseconds(void)
     return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000ULL;
+}
+
 /*
 =================
 Sys_Quit
@@ -118,6 +125,7 @@ void Sys_AddDefaultConfig(void)
 
     cmd_buffer.text[len] = 0;
     cmd_buffer.cursize = COM_Compress(cmd_buffer.text);
+    cmd_buffer.readcount = 0;
     if (cmd_buffer.cursize) {
         Com_Printf("Execing %s\n", SYS_SITE_CFG);
         Cbuf_Execute(&cmd_buffer);
@@ -133,6 +141,28 @@ void Sys_Sleep(int msec)
     nanosleep(&req, NULL);
 }
 
+// sleeps until Sys_Microseconds() reaches the given value
+void Sys_SleepUntil(uint64_t usec)
+{
+#ifdef TIMER_ABSTIME
+    struct timespec req = {
+        .tv_sec = usec / 1000000,
+        .tv_nsec = (usec % 1000000) * 1000
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL) == EINTR)
+        ;
+#else
+    uint64_t now;
+    while ((now = Sys_Microseconds()) < usec) {
+        struct timespec req = {
+            .tv_sec = (usec - now) / 1000000,
+            .tv_nsec = ((usec - now) % 1000000) * 1000
+        };
+        nanosleep(&req, NULL);
+    }
+#endif
+}
+
 const char *Sys_ErrorString(int err)
 {
     return strerror(err);
@@ -868,6 +868,14 @@ unsigned Sys_Milliseconds(void)
     return tm.QuadPart * 1000ULL / timer_freq.QuadPart;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    LARGE_INTEGER tm;
+    QueryPerformanceCounter(&tm);
+    return tm.QuadPart / timer_freq.QuadPart * 1000000ULL +
+           tm.QuadPart % timer_freq.QuadPart * 1000000ULL / timer_freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }
@@ -877,6 +885,20 @@ void Sys_Sleep(int msec)
     Sleep(msec);
 }
 
+// Sleep() has millisecond granularity at best and may wake up early or late,
+// so sleep off whole milliseconds but one and yield until deadline is reached
+void Sys_SleepUntil(uint64_t usec)
+{
+    uint64_t now;
+
+    while ((now = Sys_Microseconds()) < usec) {
+        if (usec - now >= 2000)
+            Sleep((usec - now) / 1000 - 1);
+        else
+            Sleep(0);
+    }
+}
+
 const char *Sys_ErrorString(int err)
 {
     static char buf[256];